@@ -0,0 +1,55 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Code generation scaling benchmark for tane
+# Usage: ./bench/regalloc.sh [max_statements]
+# Compiles one generated function of N statements for N = max/8 .. max, at
+# -O0 and -O1, and prints the compile time per statement. With linear
+# register allocation the last column stays roughly flat as N doubles.
+
+BIN="build/tane"
+MAX="${1:-100000}"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+if [[ ! -x "$BIN" ]]; then
+  echo "Error: $BIN is not built yet. Run 'make' first." >&2
+  exit 1
+fi
+
+gen_source() {
+  local n="$1"
+  awk -v n="$n" 'BEGIN {
+    print "fn main() {"
+    print "    let mut a;"
+    print "    let mut b;"
+    print "    let mut c;"
+    print "    a = 1;"
+    print "    b = 2;"
+    print "    c = 3;"
+    for (i = 0; i < n; i++) {
+      k = i % 4
+      if (k == 0)      print "    a = a + b * " (i % 7) " - c;"
+      else if (k == 1) print "    b = (b ^ a) & " (i % 255) ";"
+      else if (k == 2) print "    if a < b { c = c + 1; } else { c = c - 1; }"
+      else             print "    c = c + (a << 1) + (b >> 2);"
+    }
+    print "    return c;"
+    print "}"
+  }'
+}
+
+# -O0 keeps every local in memory, so ISel folds the most operands there
+printf "%4s %10s %10s %12s\n" "opt" "stmts" "seconds" "us/stmt"
+for opt in -O0 -O1; do
+  n=$((MAX / 8))
+  while (( n <= MAX )); do
+    src="$WORK/bench_$n.tn"
+    gen_source "$n" > "$src"
+    t0=$(date +%s.%N)
+    "$BIN" "$opt" "$src" -o "$WORK/out.s"
+    t1=$(date +%s.%N)
+    awk -v opt="$opt" -v n="$n" -v t0="$t0" -v t1="$t1" 'BEGIN { d = t1 - t0; printf "%4s %10d %10.3f %12.3f\n", opt, n, d, d * 1e6 / n }'
+    n=$((n * 2))
+  done
+done
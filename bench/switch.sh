@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Switch dispatch benchmark for tane
+# Usage: ./bench/switch.sh [cases] [iterations]
+# Runs a hot loop over a switch with N cases, once with dense case values
+# (lowered to a jump table) and once with sparse ones (binary search), and
+# prints the run time and time per dispatch.
+
+BIN="build/tane"
+CASES="${1:-200}"
+ITERS="${2:-20000000}"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+if [[ ! -x "$BIN" ]]; then
+  echo "Error: $BIN is not built yet. Run 'make' first." >&2
+  exit 1
+fi
+
+# gen_source <cases> <iterations> <stride>: case values are 0, stride, 2*stride, ...
+gen_source() {
+  awk -v n="$1" -v iters="$2" -v stride="$3" 'BEGIN {
+    print "fn main() {"
+    print "    let mut s;"
+    print "    let mut i;"
+    print "    s = 0;"
+    print "    i = 0;"
+    print "    while i < " iters " {"
+    print "        s = s + switch i % " n " * " stride " {"
+    for (k = 0; k < n; k++) {
+      print "            " k * stride " => " (k * 7 + 3) % 11 ","
+    }
+    print "        };"
+    print "        i = i + 1;"
+    print "    }"
+    print "    return s % 256;"
+    print "}"
+  }'
+}
+
+printf "%-8s %8s %10s %10s\n" "layout" "cases" "seconds" "ns/iter"
+for layout in dense:1 sparse:37; do
+  name="${layout%%:*}"
+  stride="${layout##*:}"
+  gen_source "$CASES" "$ITERS" "$stride" > "$WORK/$name.tn"
+  "$BIN" "$WORK/$name.tn" -o "$WORK/$name.s"
+  gcc -o "$WORK/$name" "$WORK/$name.s" 2>/dev/null
+  t0=$(date +%s.%N)
+  "$WORK/$name" || true
+  t1=$(date +%s.%N)
+  awk -v l="$name" -v n="$CASES" -v it="$ITERS" -v t0="$t0" -v t1="$t1" \
+    'BEGIN { d = t1 - t0; printf "%-8s %8d %10.3f %10.2f\n", l, n, d, d * 1e9 / it }'
+done
@@ -0,0 +1,59 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Tokenizer throughput benchmark for tane
+# Usage: ./bench/tokenizer.sh [functions]
+# Generates two sources of N functions each (roughly 10 and 20 MB by
+# default) and prints tokens/sec and MB/sec of the scanner alone, once per
+# span scanner the CPU supports (scalar, SSE2, AVX2):
+#   code - short names, 4-space indentation, like hand-written code
+#   wide - deep indentation, long identifiers and string literals, like
+#          machine-generated code
+# Numbers are only meaningful for an optimized build, e.g.
+#   make clean && make CXXFLAGS="-O2 -std=c++20"
+
+BIN="build/tane"
+FUNCS="${1:-30000}"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+if [[ ! -x "$BIN" ]]; then
+  echo "Error: $BIN is not built yet. Run 'make' first." >&2
+  exit 1
+fi
+
+awk -v n="$FUNCS" 'BEGIN {
+  print "import io;"
+  for (i = 0; i < n; i++) {
+    print "fn function_" i "(alpha, beta) {"
+    print "    let mut total;"
+    print "    total = alpha * " (i % 97) " + (beta << 2) - " i ";"
+    print "    while 1000 <= total && beta != 0 {"
+    print "        total = total / 3 % 1000;"
+    print "    }"
+    print "    if total <= beta || alpha == 7 { print(\"function " i " took the first branch\\n\"); }"
+    print "    return total ^ (alpha & beta) | 1;"
+    print "}"
+  }
+  print "fn main() { return 0; }"
+}' > "$WORK/code.tn"
+
+awk -v n="$FUNCS" 'BEGIN {
+  pad = "                                "
+  print "import io;"
+  for (i = 0; i < n; i++) {
+    f = "generated_handler_for_request_kind_" i
+    print "fn " f "(incoming_request_identifier, accumulated_running_total) {"
+    print pad "let mut intermediate_computation_result;"
+    print pad "intermediate_computation_result = incoming_request_identifier * 1234567 + accumulated_running_total;"
+    print pad pad "if intermediate_computation_result < 100000000 { print(\"" f " reached the lower bound of its expected range\\n\"); }"
+    print pad "return intermediate_computation_result;"
+    print "}"
+  }
+  print "fn main() { return 0; }"
+}' > "$WORK/wide.tn"
+
+for src in code wide; do
+  echo "== $src"
+  "$BIN" "$WORK/$src.tn" --bench-tokenizer
+done
@@ -0,0 +1,255 @@
+#include "cfg.h"
+#include "gen_ir.h"
+#include "context.h"
+
+#include <algorithm>
+
+void CFG::build(const IRFunc& f){
+    blocks.clear();
+    labelBlock.clear();
+    exits.clear();
+
+    const auto& pool = f.instrPool;
+
+    // split into blocks: a block starts at a label or after a branch
+    for(size_t i = 0; i < pool.size(); i++){
+        const IRInstr& ins = pool[i];
+        bool leader = (i == 0) || ins.cmd == IRCmd::LLABEL || isTerminator(pool[i - 1].cmd);
+        if(leader){
+            if(!blocks.empty()){
+                blocks.back().end = i;
+            }
+            BasicBlock bb;
+            bb.begin = i;
+            if(ins.cmd == IRCmd::LLABEL){
+                bb.label = ins.imm;
+                labelBlock[ins.imm] = blocks.size();
+            }
+            blocks.push_back(bb);
+        }
+    }
+    if(!blocks.empty()){
+        blocks.back().end = pool.size();
+    }
+
+    // connect edges, once per distinct successor
+    std::vector<BlockIdx> linkedFrom(blocks.size(), -1);
+    auto link = [&](BlockIdx from, BlockIdx to){
+        if(linkedFrom[to] == from){
+            return;
+        }
+        linkedFrom[to] = from;
+        blocks[from].succs.push_back(to);
+        blocks[to].preds.push_back(from);
+    };
+    for(size_t b = 0; b < blocks.size(); b++){
+        const IRInstr& last = pool[blocks[b].end - 1];
+        switch(last.cmd){
+            case IRCmd::RET:
+            case IRCmd::TAILCALL:
+                exits.push_back(b);
+                break;
+            case IRCmd::JMP:
+                link(b, labelBlock.at(last.imm));
+                break;
+            case IRCmd::JTABLE:
+                for(auto label : last.labels){
+                    link(b, labelBlock.at(label));
+                }
+                link(b, labelBlock.at(last.imm));
+                break;
+            default:
+                if(isCondBranch(last.cmd)){
+                    link(b, labelBlock.at(last.imm));
+                }
+                if(b + 1 < blocks.size()){
+                    link(b, b + 1);
+                }
+                break;
+        }
+    }
+
+    computeOrder();
+}
+
+// reverse postorder from the entry block
+void CFG::computeOrder(){
+    rpo.clear();
+    rpoIndex.assign(blocks.size(), -1);
+    if(blocks.empty()) return;
+
+    std::vector<std::pair<BlockIdx, size_t>> stack;
+    std::vector<bool> visited(blocks.size(), false);
+    stack.push_back({entry, 0});
+    visited[entry] = true;
+    while(!stack.empty()){
+        auto& [b, next] = stack.back();
+        if(next < blocks[b].succs.size()){
+            BlockIdx s = blocks[b].succs[next++];
+            if(!visited[s]){
+                visited[s] = true;
+                stack.push_back({s, 0});
+            }
+        } else {
+            rpo.push_back(b);
+            stack.pop_back();
+        }
+    }
+    std::reverse(rpo.begin(), rpo.end());
+    for(size_t i = 0; i < rpo.size(); i++){
+        rpoIndex[rpo[i]] = i;
+    }
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+void CFG::computeDominators(){
+    if(blocks.empty()) return;
+
+    for(auto& bb : blocks){
+        bb.idom = -1;
+        bb.domChildren.clear();
+        bb.df.clear();
+        bb.domPre = bb.domPost = -1;
+    }
+
+    auto intersect = [&](BlockIdx a, BlockIdx b){
+        while(a != b){
+            while(rpoIndex[a] > rpoIndex[b]) a = blocks[a].idom;
+            while(rpoIndex[b] > rpoIndex[a]) b = blocks[b].idom;
+        }
+        return a;
+    };
+
+    blocks[entry].idom = entry;
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(size_t i = 1; i < rpo.size(); i++){
+            BlockIdx b = rpo[i];
+            BlockIdx newIdom = -1;
+            for(auto p : blocks[b].preds){
+                if(blocks[p].idom == -1) continue;
+                newIdom = (newIdom == -1) ? p : intersect(p, newIdom);
+            }
+            if(blocks[b].idom != newIdom){
+                blocks[b].idom = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    for(size_t i = 1; i < rpo.size(); i++){
+        BlockIdx b = rpo[i];
+        blocks[blocks[b].idom].domChildren.push_back(b);
+    }
+
+    // pre/post order over the dominator tree: a dominates b exactly when
+    // b's interval nests in a's
+    int32_t counter = 0;
+    std::vector<std::pair<BlockIdx, size_t>> stack = {{entry, 0}};
+    blocks[entry].domPre = counter++;
+    while(!stack.empty()){
+        auto& [b, next] = stack.back();
+        if(next < blocks[b].domChildren.size()){
+            BlockIdx c = blocks[b].domChildren[next++];
+            blocks[c].domPre = counter++;
+            stack.push_back({c, 0});
+        } else {
+            blocks[b].domPost = counter++;
+            stack.pop_back();
+        }
+    }
+
+    // dominance frontiers
+    for(auto b : rpo){
+        BasicBlock& bb = blocks[b];
+        if(bb.preds.size() < 2) continue;
+        for(auto p : bb.preds){
+            if(blocks[p].idom == -1) continue;
+            BlockIdx runner = p;
+            while(runner != bb.idom){
+                auto& df = blocks[runner].df;
+                if(df.empty() || df.back() != b){
+                    df.push_back(b);
+                }
+                runner = blocks[runner].idom;
+            }
+        }
+    }
+}
+
+bool CFG::dominates(BlockIdx a, BlockIdx b) const{
+    if(a == b) return true;
+    const BasicBlock& ba = blocks[a];
+    const BasicBlock& bb = blocks[b];
+    if(ba.domPre < 0 || bb.domPre < 0) return false;
+    return ba.domPre < bb.domPre && bb.domPost < ba.domPost;
+}
+
+// One loop per header; an edge is a back edge when its target dominates
+// its source.
+std::vector<Loop> CFG::findLoops() const{
+    std::vector<Loop> loops;
+    std::vector<int32_t> loopOf(blocks.size(), -1);
+    for(auto latch : rpo){
+        for(auto h : blocks[latch].succs){
+            if(!dominates(h, latch)) continue;
+            if(loopOf[h] < 0){
+                loopOf[h] = loops.size();
+                loops.emplace_back();
+                loops.back().header = h;
+            }
+            loops[loopOf[h]].latches.push_back(latch);
+        }
+    }
+    // the body is everything reaching a latch without passing the header;
+    // seen[] holds the loop that last visited each block
+    std::vector<int32_t> seen(blocks.size(), -1);
+    std::vector<BlockIdx> work;
+    for(size_t li = 0; li < loops.size(); li++){
+        Loop& l = loops[li];
+        seen[l.header] = li;
+        l.blocks.push_back(l.header);
+        for(auto latch : l.latches){
+            if(seen[latch] == (int32_t)li) continue;
+            seen[latch] = li;
+            l.blocks.push_back(latch);
+            work.push_back(latch);
+        }
+        while(!work.empty()){
+            BlockIdx b = work.back();
+            work.pop_back();
+            for(auto p : blocks[b].preds){
+                if(seen[p] == (int32_t)li || !reachable(p)) continue;
+                seen[p] = li;
+                l.blocks.push_back(p);
+                work.push_back(p);
+            }
+        }
+        std::sort(l.blocks.begin(), l.blocks.end());
+    }
+    // a loop nested in another has fewer blocks
+    std::stable_sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b){ return a.blocks.size() < b.blocks.size(); });
+    return loops;
+}
+
+void CFG::printDot(const IRFunc& f, const IRModule& irm, Output& out) const{
+    out.print("  subgraph \"cluster_{}\" {{\n", f.fname);
+    out.print("    label=\"{}\";\n", f.fname);
+    for(size_t b = 0; b < blocks.size(); b++){
+        const BasicBlock& bb = blocks[b];
+        std::string body;
+        for(size_t i = bb.begin; i < bb.end; i++){
+            body += irm.instrString(f.instrPool[i]);
+            body += "\\l";
+        }
+        out.print("    \"{}_{}\" [shape=box{}, label=\"{}\"];\n",
+            f.fname, b, reachable(b) ? "" : ", style=dashed", body);
+    }
+    for(size_t b = 0; b < blocks.size(); b++){
+        for(auto s : blocks[b].succs){
+            out.print("    \"{}_{}\" -> \"{}_{}\";\n", f.fname, b, f.fname, s);
+        }
+    }
+    out.print("  }}\n");
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include "common_type.h"
+
+class IRFunc;
+class IRModule;
+class Output;
+
+/// A maximal straight-line run of instructions in IRFunc::instrPool.
+class BasicBlock{
+public:
+    int32_t label = -1;             // LLABEL at the head of the block, -1 if none
+    size_t begin = 0;               // index of the first instruction
+    size_t end = 0;                 // one past the last instruction
+    std::vector<BlockIdx> preds;
+    std::vector<BlockIdx> succs;
+
+    // filled by CFG::computeDominators
+    BlockIdx idom = -1;             // immediate dominator, -1 if unreachable
+    std::vector<BlockIdx> domChildren;
+    std::vector<BlockIdx> df;       // dominance frontier
+    int32_t domPre = -1;            // dominator tree DFS numbering, -1 if unreachable
+    int32_t domPost = -1;
+};
+
+/// A natural loop: its header and every block that reaches one of the
+/// header's back edges without passing through the header.
+class Loop{
+public:
+    BlockIdx header = -1;
+    std::vector<BlockIdx> blocks;   // header and body, ascending
+    std::vector<BlockIdx> latches;  // sources of the back edges
+};
+
+/// Control flow graph over the flat instruction list of an IRFunc.
+/// Built once after IR generation (IRFunc::buildCFG) and rebuilt by any pass
+/// that rewrites the instruction list, so analyses never rescan it for labels.
+class CFG{
+    void computeOrder();
+public:
+    std::vector<BasicBlock> blocks;
+    std::unordered_map<int32_t, BlockIdx> labelBlock;   // label id -> block
+    BlockIdx entry = 0;
+    std::vector<BlockIdx> exits;                        // blocks ending in RET
+    std::vector<BlockIdx> rpo;                          // reachable blocks in reverse postorder
+    std::vector<int32_t> rpoIndex;                      // position in rpo, -1 if unreachable
+
+    void build(const IRFunc& f);
+    void computeDominators();
+    bool dominates(BlockIdx a, BlockIdx b) const;   // O(1) by the DFS numbering
+    std::vector<Loop> findLoops() const;        // needs computeDominators, innermost first
+    bool reachable(BlockIdx idx) const { return rpoIndex[idx] >= 0; }
+    BasicBlock& getBlock(BlockIdx idx) { return blocks[idx]; }
+    void printDot(const IRFunc& f, const IRModule& irm, Output& out) const;
+};
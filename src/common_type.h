@@ -6,3 +6,4 @@ using ASTIdx = int32_t;
 using SymbolIdx = int32_t;
 using VRegID = int32_t;
 using ScopeIdx = int32_t;
+using BlockIdx = int32_t;
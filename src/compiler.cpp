@@ -3,12 +3,27 @@
 #include "parse.h"
 #include "gen_ir.h"
 #include "gen_x86-64.h"
+#include "elf64.h"
+#include "link.h"
+#include "jit.h"
+#include "opt.h"
+#include "context.h"
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <sstream>
 
+// inliner threshold for -O0, -O1 and -O2
+static const uint32_t INLINE_THRESHOLD[] = {0, 8, 24};
+
 void Compiler::compileSource(const std::string& srccode, std::string modulename) {
 
+    if(options.benchTokenizer){
+        benchTokenizer(srccode);
+        return;
+    }
+
     // Tokenize
     Tokenizer tokenizer;
     Tokenizer::TokenStream& ts = tokenizer.scan(const_cast<char*>(srccode.c_str()));
@@ -30,12 +45,103 @@ void Compiler::compileSource(const std::string& srccode, std::string modulename)
         // if bind only, stop here
         return;
     }
+    // Optimize
+    OptStats stats;
+    PassManager passes(stats, options.timePasses);
+    passes.setInlineThreshold(options.inlineThreshold >= 0 ? options.inlineThreshold
+                              : INLINE_THRESHOLD[std::min(options.optLevel, 2)]);
+    if(options.customPasses){
+        passes.addList(options.passes);
+    } else {
+        passes.addPreset(options.optLevel);
+    }
+    passes.run(mod);
+    if(options.stats){
+        stats.print();
+    }
+
+    if(options.emitCFG){
+        // dot dump of the control flow graph handed to the code generator
+        Output dot;
+        dot.setStdioContext();
+        dot.print("digraph \"{}\" {{\n", modulename);
+        for(auto& func : mod.funcPool){
+            func.getCFG().printDot(func, mod, dot);
+        }
+        dot.print("}}\n");
+        dot.flush();
+    }
+
     // Emit IR
     X86Generator x86gen(mod);
+    if(options.emitObject || options.link || options.run){
+        ObjectCode obj;
+        x86gen.emitObject(obj);
+        if(options.run){
+            runResult = JIT(obj).run();
+        } else if(options.link){
+            linkExecutable(obj);
+        } else {
+            writeElfObject(obj, options.output_file);
+        }
+        return;
+    }
     x86gen.setOutputFile(options.output_file);
     x86gen.emit();
 }
 
+// Links the module with the standard library's std.o, found as obj/std.o
+// under a module directory, and a _start that calls main then exit.
+void Compiler::linkExecutable(const ObjectCode& obj){
+    std::string stdPath = options.modulePath.resolveObject("std");
+    if(stdPath.empty()){
+        fprintf(stderr, "Error: Cannot find obj/std.o in the module directories (run 'make std')\n");
+        exit(1);
+    }
+    ObjectCode stdObj;
+    readElfObject(stdPath, stdObj);
+
+    Linker linker;
+    linker.add(obj);
+    linker.add(stdObj);
+    linker.addStartup();
+    linker.writeExecutable(options.output_file);
+}
+
+// Scans the source repeatedly for at least half a second with each span
+// scanner the CPU supports and reports the tokenizer's throughput and the
+// size of one token stream.
+void Compiler::benchTokenizer(const std::string& srccode){
+    using Clock = std::chrono::steady_clock;
+    using Isa = SpanScanner::Isa;
+    Tokenizer tokenizer;
+    size_t tokens = 0;
+    {
+        Tokenizer::TokenStream& ts = tokenizer.scan(const_cast<char*>(srccode.c_str()));
+        tokens = ts.size();
+        delete &ts;
+    }
+    fprintf(stderr, "bytes  %12zu\n", srccode.size());
+    fprintf(stderr, "tokens %12zu (%zu bytes each, %.1f MB)\n", tokens, sizeof(Token),
+            tokens * sizeof(Token) / 1e6);
+    fprintf(stderr, "%-8s %12s %14s %10s\n", "scanner", "ms", "M tokens/sec", "MB/sec");
+    for(Isa isa : {Isa::Scalar, Isa::SSE2, Isa::AVX2}){
+        if(!SpanScanner::supported(isa)) continue;
+        tokenizer.spans = &SpanScanner::get(isa);
+        size_t rounds = 0;
+        double seconds = 0;
+        auto start = Clock::now();
+        while(seconds < 0.5){
+            delete &tokenizer.scan(const_cast<char*>(srccode.c_str()));
+            rounds++;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        double perRound = seconds / rounds;
+        fprintf(stderr, "%-8s %12.3f %14.3f %10.3f\n", tokenizer.spans->name, perRound * 1e3,
+                tokens / perRound / 1e6, srccode.size() / perRound / 1e6);
+    }
+}
+
 void Compiler::compileFile(const std::string& filepath){
     std::string srccode = readFile(filepath);
 
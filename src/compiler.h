@@ -3,12 +3,24 @@
 #include <string>
 #include "paths.h"
 #include "tnlib_loader.h"
+#include "encode_x86-64.h"
 
 class CompileOptions {
 public:
     bool emitIR = false;
     bool emitAssembly = true;
     bool bindOnly = false;
+    bool emitObject = false;        // ELF object instead of assembly text
+    bool link = false;              // static executable linked with std.o
+    bool run = false;               // JIT main in-process, no output file
+    bool emitCFG = false;
+    bool stats = false;
+    int optLevel = 1;
+    int inlineThreshold = -1;       // -1: chosen by optLevel
+    bool customPasses = false;      // passes replaces the optLevel preset
+    std::string passes = "";        // comma separated pass names
+    bool timePasses = false;
+    bool benchTokenizer = false;    // time scanning the source, then stop
     ModulePath& modulePath;
     std::string output_file;
     moduleSet& loadedModules;
@@ -17,11 +29,15 @@ public:
 class Compiler {
     CompileOptions& options;
     std::string targetDir = "";
+    int64_t runResult = 0;
     std::string getModuleName(const char* filepath);
     std::string readFile(const std::string& filename);
+    void linkExecutable(const ObjectCode& obj);
+    void benchTokenizer(const std::string& srccode);
 public:
     Compiler(CompileOptions& options) : options(options) {};
 
     void compileSource(const std::string& srccode, std::string modulename = "");
     void compileFile(const std::string& filepath);
+    int64_t result() const { return runResult; }    // main's return value with --run
 };
@@ -0,0 +1,221 @@
+#include "opt.h"
+
+#include <unordered_map>
+
+namespace {
+
+template <class F>
+void forEachSrc(const IRInstr& ins, F fn){
+    if(ins.s1 >= 0) fn(ins.s1);
+    if(ins.s2 >= 0) fn(ins.s2);
+    for(auto a : ins.args) fn(a);
+}
+
+} // namespace
+
+// Drop blocks the entry cannot reach, and their PHI inputs.
+uint64_t DCE::removeUnreachable(){
+    CFG& cfg = f.cfg;
+    auto& pool = f.instrPool;
+    uint64_t removed = 0;
+    std::vector<IRInstr> out;
+    out.reserve(pool.size());
+    for(size_t b = 0; b < cfg.blocks.size(); b++){
+        BasicBlock& bb = cfg.blocks[b];
+        if(!cfg.reachable(b)){
+            removed += bb.end - bb.begin;
+            continue;
+        }
+        for(size_t i = bb.begin; i < bb.end; i++){
+            IRInstr ins = pool[i];
+            if(ins.cmd == IRCmd::PHI){
+                size_t w = 0;
+                for(size_t k = 0; k < ins.labels.size(); k++){
+                    if(!cfg.reachable(cfg.labelBlock.at(ins.labels[k]))) continue;
+                    ins.args[w] = ins.args[k];
+                    ins.labels[w] = ins.labels[k];
+                    w++;
+                }
+                ins.args.resize(w);
+                ins.labels.resize(w);
+            }
+            out.push_back(std::move(ins));
+        }
+    }
+    if(removed){
+        pool.swap(out);
+        cfg.build(f);
+    }
+    return removed;
+}
+
+// Backward liveness of frame slots. A SAVE to a slot that no LOAD reads
+// before it is overwritten or the function returns is marked dead.
+uint64_t DCE::markDeadStores(std::vector<bool>& dead){
+    CFG& cfg = f.cfg;
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+    size_t nB = cfg.blocks.size();
+
+    // slot index of every FRAME_ADDR result; slots whose address is used
+    // for anything but LOAD/SAVE are never touched
+    std::unordered_map<int32_t, int32_t> slotIdx;
+    std::vector<int32_t> slotOf(nV, -1);
+    for(auto& ins : pool){
+        if(ins.cmd != IRCmd::FRAME_ADDR) continue;
+        auto it = slotIdx.emplace(ins.imm, (int32_t)slotIdx.size()).first;
+        slotOf[ins.t] = it->second;
+    }
+    size_t nS = slotIdx.size();
+    if(nS == 0) return 0;
+    std::vector<bool> escaped(nS, false);
+    bool unknownLoad = false;
+    for(auto& ins : pool){
+        if(ins.cmd == IRCmd::LOAD && slotOf[ins.s1] < 0) unknownLoad = true;
+        forEachSrc(ins, [&](VRegID v){
+            if(slotOf[v] < 0) return;
+            bool addr = (ins.cmd == IRCmd::LOAD || ins.cmd == IRCmd::SAVE) && v == ins.s1 && v != ins.s2;
+            if(!addr) escaped[slotOf[v]] = true;
+        });
+    }
+    if(unknownLoad) return 0;
+
+    // live slots on block entry, iterated to a fixed point
+    std::vector<std::vector<bool>> liveIn(nB, std::vector<bool>(nS, false));
+    auto liveOutOf = [&](BlockIdx b){
+        std::vector<bool> live(nS, false);
+        for(auto s : cfg.blocks[b].succs){
+            for(size_t k = 0; k < nS; k++){
+                if(liveIn[s][k]) live[k] = true;
+            }
+        }
+        return live;
+    };
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(auto it = cfg.rpo.rbegin(); it != cfg.rpo.rend(); it++){
+            BlockIdx b = *it;
+            std::vector<bool> live = liveOutOf(b);
+            for(size_t i = cfg.blocks[b].end; i-- > cfg.blocks[b].begin; ){
+                const IRInstr& ins = pool[i];
+                // a SAVE through any other address can only reach an escaped slot
+                if(ins.s1 < 0 || slotOf[ins.s1] < 0) continue;
+                if(ins.cmd == IRCmd::SAVE) live[slotOf[ins.s1]] = false;
+                if(ins.cmd == IRCmd::LOAD) live[slotOf[ins.s1]] = true;
+            }
+            if(live != liveIn[b]){
+                liveIn[b] = live;
+                changed = true;
+            }
+        }
+    }
+
+    uint64_t stores = 0;
+    for(auto b : cfg.rpo){
+        std::vector<bool> live = liveOutOf(b);
+        for(size_t i = cfg.blocks[b].end; i-- > cfg.blocks[b].begin; ){
+            const IRInstr& ins = pool[i];
+            if(ins.s1 < 0 || slotOf[ins.s1] < 0) continue;
+            if(ins.cmd == IRCmd::SAVE){
+                int32_t s = slotOf[ins.s1];
+                if(!live[s] && !escaped[s]){
+                    dead[i] = true;
+                    stores++;
+                }
+                live[s] = false;
+            }
+            if(ins.cmd == IRCmd::LOAD) live[slotOf[ins.s1]] = true;
+        }
+    }
+    return stores;
+}
+
+void DCE::run(){
+    uint64_t removed = removeUnreachable();
+
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+    std::vector<bool> dead(pool.size(), false);
+    uint64_t stores = markDeadStores(dead);
+
+    // definitions of each vreg
+    std::vector<size_t> defBegin(nV + 1, 0);
+    for(auto& ins : pool){
+        if(ins.t >= 0) defBegin[ins.t + 1]++;
+    }
+    for(size_t v = 0; v < nV; v++){
+        defBegin[v + 1] += defBegin[v];
+    }
+    std::vector<size_t> defList(defBegin[nV]);
+    {
+        std::vector<size_t> fill(defBegin.begin(), defBegin.end() - 1);
+        for(size_t i = 0; i < pool.size(); i++){
+            if(pool[i].t >= 0) defList[fill[pool[i].t]++] = i;
+        }
+    }
+    auto nonZeroConst = [&](VRegID v){
+        if(defBegin[v + 1] - defBegin[v] != 1) return false;
+        const IRInstr& def = pool[defList[defBegin[v]]];
+        return def.cmd == IRCmd::MOV_IMM && def.imm != 0 && def.imm != -1;
+    };
+
+    // instructions that matter regardless of their result
+    std::vector<bool> live(pool.size(), false);
+    std::vector<size_t> work;
+    for(size_t i = 0; i < pool.size(); i++){
+        const IRInstr& ins = pool[i];
+        bool critical;
+        switch(ins.cmd){
+            case IRCmd::LLABEL:
+            case IRCmd::CALL:
+            case IRCmd::TAILCALL:
+            case IRCmd::SAVE:
+            case IRCmd::SPILL:
+                critical = !dead[i];
+                break;
+            case IRCmd::DIV:
+            case IRCmd::MOD:
+                // may trap on a zero divisor
+                critical = !nonZeroConst(ins.s2);
+                break;
+            default:
+                critical = isTerminator(ins.cmd);
+                break;
+        }
+        if(critical){
+            live[i] = true;
+            work.push_back(i);
+        }
+    }
+    while(!work.empty()){
+        size_t i = work.back();
+        work.pop_back();
+        forEachSrc(pool[i], [&](VRegID v){
+            for(size_t k = defBegin[v]; k < defBegin[v + 1]; k++){
+                size_t d = defList[k];
+                if(!live[d]){
+                    live[d] = true;
+                    work.push_back(d);
+                }
+            }
+        });
+    }
+
+    size_t w = 0;
+    for(size_t i = 0; i < pool.size(); i++){
+        if(!live[i]){
+            removed++;
+            continue;
+        }
+        if(w != i) pool[w] = std::move(pool[i]);
+        w++;
+    }
+    if(w != pool.size()){
+        pool.resize(w);
+        f.cfg.build(f);
+    }
+
+    stats.add("dce.removed", removed);
+    stats.add("dce.dead-stores", stores);
+}
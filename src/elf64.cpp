@@ -0,0 +1,378 @@
+#include "elf64.h"
+
+#include <elf.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+using Section = ObjectCode::Section;
+
+// section header indices
+enum : uint16_t { SEC_NULL, SEC_TEXT, SEC_RODATA, SEC_RELA_TEXT, SEC_RELA_RODATA,
+                  SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB, SEC_NOTE_STACK, SEC_COUNT };
+
+// symbol table indices of the two section symbols
+enum : uint32_t { SYM_TEXT = 1, SYM_RODATA = 2 };
+
+class StringTable{
+public:
+    Bytes bytes{0};
+    uint32_t add(const std::string& s){
+        uint32_t at = bytes.size();
+        bytes.insert(bytes.end(), s.begin(), s.end());
+        bytes.push_back(0);
+        return at;
+    }
+};
+
+template <class T>
+void put(Bytes& out, const T& v){
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+void align(Bytes& out, size_t a){
+    while(out.size() % a){
+        out.push_back(0);
+    }
+}
+
+void writeFile(const Bytes& out, const std::string& path, mode_t mode){
+    FILE* fp = fopen(path.c_str(), "wb");
+    if(!fp){
+        fprintf(stderr, "Cannot open file: %s\n", path.c_str());
+        exit(1);
+    }
+    fwrite(out.data(), 1, out.size(), fp);
+    fclose(fp);
+    chmod(path.c_str(), mode);
+}
+
+uint16_t sectionIndex(Section s){
+    switch(s){
+        case Section::Text: return SEC_TEXT;
+        case Section::Rodata: return SEC_RODATA;
+        default: return SHN_UNDEF;
+    }
+}
+
+} // namespace
+
+void writeElfObject(const ObjectCode& obj, const std::string& path){
+    // symbols: null, the two sections, locals, then globals
+    StringTable strtab;
+    Bytes symtab;
+    put(symtab, Elf64_Sym{});
+    for(uint16_t sec : {SEC_TEXT, SEC_RODATA}){
+        Elf64_Sym s{};
+        s.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        s.st_shndx = sec;
+        put(symtab, s);
+    }
+    std::unordered_map<std::string, uint32_t> symIndex;
+    uint32_t count = 3, firstGlobal = 0;
+    for(bool global : {false, true}){
+        if(global) firstGlobal = count;
+        for(auto& sym : obj.symbols){
+            if(sym.global != global) continue;
+            Elf64_Sym s{};
+            s.st_name = strtab.add(sym.name);
+            bool defined = sym.section != Section::Undef;
+            s.st_info = ELF64_ST_INFO(global ? STB_GLOBAL : STB_LOCAL, defined ? STT_FUNC : STT_NOTYPE);
+            s.st_shndx = sectionIndex(sym.section);
+            s.st_value = sym.offset;
+            put(symtab, s);
+            symIndex[sym.name] = count++;
+        }
+    }
+
+    Bytes rela[2];
+    for(auto& r : obj.relocs){
+        Elf64_Rela e{};
+        uint32_t sym = r.sym.empty() ? ((r.target == Section::Text) ? SYM_TEXT : SYM_RODATA)
+                                     : symIndex.at(r.sym);
+        e.r_offset = r.offset;
+        e.r_info = ELF64_R_INFO(sym, r.call ? R_X86_64_PLT32 : R_X86_64_PC32);
+        e.r_addend = r.addend;
+        put(rela[r.section == Section::Text ? 0 : 1], e);
+    }
+
+    // file layout: header, section contents, section headers
+    Bytes out(sizeof(Elf64_Ehdr), 0);
+    Elf64_Shdr sh[SEC_COUNT]{};
+    StringTable shstrtab;
+    auto place = [&](uint16_t idx, const char* name, uint32_t type, uint64_t flags,
+                     const Bytes& data, size_t alignment){
+        align(out, alignment);
+        sh[idx].sh_name = shstrtab.add(name);
+        sh[idx].sh_type = type;
+        sh[idx].sh_flags = flags;
+        sh[idx].sh_offset = out.size();
+        sh[idx].sh_size = data.size();
+        sh[idx].sh_addralign = alignment;
+        out.insert(out.end(), data.begin(), data.end());
+    };
+    place(SEC_TEXT, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, obj.text, 16);
+    place(SEC_RODATA, ".rodata", SHT_PROGBITS, SHF_ALLOC, obj.rodata, 8);
+    place(SEC_RELA_TEXT, ".rela.text", SHT_RELA, SHF_INFO_LINK, rela[0], 8);
+    place(SEC_RELA_RODATA, ".rela.rodata", SHT_RELA, SHF_INFO_LINK, rela[1], 8);
+    place(SEC_SYMTAB, ".symtab", SHT_SYMTAB, 0, symtab, 8);
+    place(SEC_STRTAB, ".strtab", SHT_STRTAB, 0, strtab.bytes, 1);
+    // no executable stack
+    place(SEC_NOTE_STACK, ".note.GNU-stack", SHT_PROGBITS, 0, {}, 1);
+    place(SEC_SHSTRTAB, ".shstrtab", SHT_STRTAB, 0, shstrtab.bytes, 1);
+
+    for(uint16_t idx : {SEC_RELA_TEXT, SEC_RELA_RODATA}){
+        sh[idx].sh_link = SEC_SYMTAB;
+        sh[idx].sh_info = (idx == SEC_RELA_TEXT) ? SEC_TEXT : SEC_RODATA;
+        sh[idx].sh_entsize = sizeof(Elf64_Rela);
+    }
+    sh[SEC_SYMTAB].sh_link = SEC_STRTAB;
+    sh[SEC_SYMTAB].sh_info = firstGlobal;
+    sh[SEC_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+
+    align(out, 8);
+    Elf64_Ehdr eh{};
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    eh.e_type = ET_REL;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_shoff = out.size();
+    eh.e_ehsize = sizeof(Elf64_Ehdr);
+    eh.e_shentsize = sizeof(Elf64_Shdr);
+    eh.e_shnum = SEC_COUNT;
+    eh.e_shstrndx = SEC_SHSTRTAB;
+    memcpy(out.data(), &eh, sizeof(eh));
+    for(auto& s : sh){
+        put(out, s);
+    }
+
+    writeFile(out, path, 0644);
+}
+
+void readElfObject(const std::string& path, ObjectCode& obj){
+    auto bad = [&](const char* what){
+        fprintf(stderr, "%s: %s\n", path.c_str(), what);
+        exit(1);
+    };
+    FILE* fp = fopen(path.c_str(), "rb");
+    if(!fp){
+        fprintf(stderr, "Cannot open file: %s\n", path.c_str());
+        exit(1);
+    }
+    Bytes file;
+    uint8_t buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0){
+        file.insert(file.end(), buf, buf + n);
+    }
+    fclose(fp);
+
+    auto at = [&](uint64_t off, uint64_t size) -> const uint8_t* {
+        if(off > file.size() || size > file.size() - off) bad("truncated ELF file");
+        return file.data() + off;
+    };
+    Elf64_Ehdr eh;
+    memcpy(&eh, at(0, sizeof(eh)), sizeof(eh));
+    if(memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 || eh.e_ident[EI_CLASS] != ELFCLASS64
+       || eh.e_type != ET_REL || eh.e_machine != EM_X86_64){
+        bad("not an x86-64 ELF relocatable object");
+    }
+    std::vector<Elf64_Shdr> sh(eh.e_shnum);
+    memcpy(sh.data(), at(eh.e_shoff, sh.size() * sizeof(Elf64_Shdr)), sh.size() * sizeof(Elf64_Shdr));
+
+    // where each loaded section ended up
+    std::vector<Section> secOf(sh.size(), Section::Undef);
+    std::vector<uint64_t> baseOf(sh.size(), 0);
+    for(size_t i = 0; i < sh.size(); i++){
+        const Elf64_Shdr& s = sh[i];
+        if(!(s.sh_flags & SHF_ALLOC) || s.sh_size == 0) continue;
+        if((s.sh_flags & SHF_WRITE) || s.sh_type != SHT_PROGBITS) bad("writable data is not supported");
+        secOf[i] = (s.sh_flags & SHF_EXECINSTR) ? Section::Text : Section::Rodata;
+        Bytes& dest = obj.bytes(secOf[i]);
+        align(dest, std::max<uint64_t>(s.sh_addralign, 1));
+        baseOf[i] = dest.size();
+        const uint8_t* p = at(s.sh_offset, s.sh_size);
+        dest.insert(dest.end(), p, p + s.sh_size);
+    }
+
+    size_t symtab = 0;
+    for(size_t i = 0; i < sh.size(); i++){
+        if(sh[i].sh_type == SHT_SYMTAB) symtab = i;
+    }
+    if(symtab == 0) return;
+    const Elf64_Shdr& st = sh[symtab];
+    const char* names = reinterpret_cast<const char*>(at(sh[st.sh_link].sh_offset, sh[st.sh_link].sh_size));
+    std::vector<Elf64_Sym> syms(st.sh_size / sizeof(Elf64_Sym));
+    memcpy(syms.data(), at(st.sh_offset, syms.size() * sizeof(Elf64_Sym)), syms.size() * sizeof(Elf64_Sym));
+    auto defined = [&](const Elf64_Sym& s){
+        return s.st_shndx != SHN_UNDEF && s.st_shndx < sh.size() && secOf[s.st_shndx] != Section::Undef;
+    };
+    for(auto& s : syms){
+        uint8_t bind = ELF64_ST_BIND(s.st_info);
+        if(bind != STB_GLOBAL && bind != STB_WEAK) continue;
+        if(defined(s)){
+            obj.symbols.push_back({names + s.st_name, secOf[s.st_shndx], baseOf[s.st_shndx] + s.st_value, true});
+        } else {
+            obj.symbols.push_back({names + s.st_name, Section::Undef, 0, true});
+        }
+    }
+
+    for(auto& rs : sh){
+        if(rs.sh_type == SHT_REL) bad("REL relocations are not supported");
+        if(rs.sh_type != SHT_RELA || rs.sh_link != symtab) continue;
+        if(rs.sh_info >= sh.size() || secOf[rs.sh_info] == Section::Undef) continue;
+        std::vector<Elf64_Rela> relas(rs.sh_size / sizeof(Elf64_Rela));
+        memcpy(relas.data(), at(rs.sh_offset, relas.size() * sizeof(Elf64_Rela)), relas.size() * sizeof(Elf64_Rela));
+        for(auto& r : relas){
+            uint32_t type = ELF64_R_TYPE(r.r_info);
+            if(type != R_X86_64_PC32 && type != R_X86_64_PLT32) bad("unsupported relocation type");
+            if(ELF64_R_SYM(r.r_info) >= syms.size()) bad("bad symbol index in relocation");
+            const Elf64_Sym& s = syms[ELF64_R_SYM(r.r_info)];
+            ObjectCode::Reloc out{secOf[rs.sh_info], baseOf[rs.sh_info] + r.r_offset, "", Section::Undef,
+                                  r.r_addend, type == R_X86_64_PLT32};
+            if(ELF64_ST_BIND(s.st_info) == STB_LOCAL && defined(s)){
+                // sections and local labels resolve inside this object
+                out.target = secOf[s.st_shndx];
+                out.addend += baseOf[s.st_shndx] + s.st_value;
+            } else {
+                out.sym = names + s.st_name;
+            }
+            obj.relocs.push_back(out);
+        }
+    }
+}
+
+namespace {
+
+const uint64_t LOAD_BASE = 0x400000;
+const uint64_t PAGE = 0x1000;
+
+uint64_t pageAlign(uint64_t v){
+    return (v + PAGE - 1) & ~(PAGE - 1);
+}
+
+} // namespace
+
+ElfLayout elfExecutableLayout(const ObjectCode& image){
+    ElfLayout l;
+    l.textOffset = PAGE;                // headers fill the first page
+    l.rodataOffset = l.textOffset + pageAlign(std::max<size_t>(image.text.size(), 1));
+    l.textAddr = LOAD_BASE + l.textOffset;
+    l.rodataAddr = LOAD_BASE + l.rodataOffset;
+    return l;
+}
+
+void writeElfExecutable(const ObjectCode& image, const ElfLayout& layout, uint64_t entry,
+                        const std::string& path){
+    std::vector<Elf64_Phdr> ph;
+    auto load = [&](uint64_t offset, uint64_t addr, uint64_t size, uint32_t flags){
+        Elf64_Phdr p{};
+        p.p_type = PT_LOAD;
+        p.p_flags = flags;
+        p.p_offset = offset;
+        p.p_vaddr = p.p_paddr = addr;
+        p.p_filesz = p.p_memsz = size;
+        p.p_align = PAGE;
+        ph.push_back(p);
+    };
+    load(layout.textOffset, layout.textAddr, image.text.size(), PF_R | PF_X);
+    if(!image.rodata.empty()){
+        load(layout.rodataOffset, layout.rodataAddr, image.rodata.size(), PF_R);
+    }
+    Elf64_Phdr stack{};
+    stack.p_type = PT_GNU_STACK;
+    stack.p_flags = PF_R | PF_W;
+    stack.p_align = 16;
+    ph.push_back(stack);
+
+    Bytes out(sizeof(Elf64_Ehdr), 0);
+    for(auto& p : ph){
+        put(out, p);
+    }
+    out.resize(layout.textOffset, 0);
+    out.insert(out.end(), image.text.begin(), image.text.end());
+    if(!image.rodata.empty()){
+        out.resize(layout.rodataOffset, 0);
+        out.insert(out.end(), image.rodata.begin(), image.rodata.end());
+    }
+
+    // sections, only for tools like objdump and gdb
+    enum : uint16_t { X_NULL, X_TEXT, X_RODATA, X_SYMTAB, X_STRTAB, X_SHSTRTAB, X_COUNT };
+    StringTable strtab, shstrtab;
+    Bytes symtab;
+    put(symtab, Elf64_Sym{});
+    for(auto& sym : image.symbols){
+        Elf64_Sym s{};
+        s.st_name = strtab.add(sym.name);
+        s.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+        s.st_shndx = (sym.section == Section::Text) ? X_TEXT : X_RODATA;
+        s.st_value = ((sym.section == Section::Text) ? layout.textAddr : layout.rodataAddr) + sym.offset;
+        put(symtab, s);
+    }
+    Elf64_Shdr sh[X_COUNT]{};
+    auto section = [&](uint16_t idx, const char* name, uint32_t type, uint64_t flags, uint64_t addr,
+                       uint64_t offset, uint64_t size, uint64_t alignment){
+        sh[idx].sh_name = shstrtab.add(name);
+        sh[idx].sh_type = type;
+        sh[idx].sh_flags = flags;
+        sh[idx].sh_addr = addr;
+        sh[idx].sh_offset = offset;
+        sh[idx].sh_size = size;
+        sh[idx].sh_addralign = alignment;
+    };
+    auto append = [&](const Bytes& data, size_t alignment){
+        align(out, alignment);
+        uint64_t at = out.size();
+        out.insert(out.end(), data.begin(), data.end());
+        return at;
+    };
+    section(X_TEXT, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, layout.textAddr,
+            layout.textOffset, image.text.size(), 16);
+    section(X_RODATA, ".rodata", SHT_PROGBITS, SHF_ALLOC, layout.rodataAddr,
+            layout.rodataOffset, image.rodata.size(), 8);
+    section(X_SYMTAB, ".symtab", SHT_SYMTAB, 0, 0, append(symtab, 8), symtab.size(), 8);
+    section(X_STRTAB, ".strtab", SHT_STRTAB, 0, 0, append(strtab.bytes, 1), strtab.bytes.size(), 1);
+    sh[X_SYMTAB].sh_link = X_STRTAB;
+    sh[X_SYMTAB].sh_info = 1;
+    sh[X_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+    sh[X_SHSTRTAB].sh_name = shstrtab.add(".shstrtab");
+    sh[X_SHSTRTAB].sh_type = SHT_STRTAB;
+    sh[X_SHSTRTAB].sh_size = shstrtab.bytes.size();
+    sh[X_SHSTRTAB].sh_offset = append(shstrtab.bytes, 1);
+    sh[X_SHSTRTAB].sh_addralign = 1;
+
+    align(out, 8);
+    Elf64_Ehdr eh{};
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    eh.e_type = ET_EXEC;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_entry = entry;
+    eh.e_phoff = sizeof(Elf64_Ehdr);
+    eh.e_shoff = out.size();
+    eh.e_ehsize = sizeof(Elf64_Ehdr);
+    eh.e_phentsize = sizeof(Elf64_Phdr);
+    eh.e_phnum = ph.size();
+    eh.e_shentsize = sizeof(Elf64_Shdr);
+    eh.e_shnum = X_COUNT;
+    eh.e_shstrndx = X_SHSTRTAB;
+    memcpy(out.data(), &eh, sizeof(eh));
+    for(auto& s : sh){
+        put(out, s);
+    }
+    writeFile(out, path, 0755);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "encode_x86-64.h"
+
+/// Writes an ELF64 relocatable object with .text, .rodata, their
+/// relocations and a symbol table; the system linker or ld can take it
+/// like the assembler's output.
+void writeElfObject(const ObjectCode& obj, const std::string& path);
+
+/// Reads an x86-64 ELF relocatable (such as std.o from the assembler)
+/// into obj. Executable sections go to text and read-only ones to rodata;
+/// writable data and relocations other than PC32/PLT32 are rejected.
+void readElfObject(const std::string& path, ObjectCode& obj);
+
+/// Where a linked image goes in a static executable: each section starts
+/// on its own page, loaded at 0x400000 plus its file offset.
+class ElfLayout{
+public:
+    uint64_t textOffset;
+    uint64_t textAddr;
+    uint64_t rodataOffset;
+    uint64_t rodataAddr;
+};
+ElfLayout elfExecutableLayout(const ObjectCode& image);
+
+/// Writes a relocated image as a static non-PIE executable: a read/execute
+/// segment for .text, a read-only one for .rodata, a non-executable stack,
+/// and a symbol table for debuggers.
+void writeElfExecutable(const ObjectCode& image, const ElfLayout& layout, uint64_t entry,
+                        const std::string& path);
@@ -0,0 +1,452 @@
+#include "encode_x86-64.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+
+namespace {
+
+using Section = ObjectCode::Section;
+using Bytes = std::vector<uint8_t>;
+
+// hardware register number of each PhysReg
+int regNum(PhysReg r){
+    static const int8_t nums[] = {-1, 10, 11, 12, 13, 14, 15, 0, 7, 6, 2, 1, 8, 9, 5, 4, -1};
+    return nums[(size_t)r];
+}
+
+bool fitsI8(int64_t v){
+    return v == (int8_t)v;
+}
+
+bool fitsI32(int64_t v){
+    return v == (int32_t)v;
+}
+
+void append(Bytes& b, int64_t v, int32_t n){
+    for(int32_t k = 0; k < n; k++){
+        b.push_back((uint8_t)(v >> (8 * k)));
+    }
+}
+
+void put32(Bytes& b, size_t at, int64_t v){
+    int32_t x = (int32_t)v;
+    memcpy(&b[at], &x, 4);
+}
+
+int32_t condCode(const std::string& cc){
+    static const char* const names[] = {
+        "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g",
+    };
+    for(int32_t k = 0; k < 16; k++){
+        if(cc == names[k]) return k;
+    }
+    return -1;
+}
+
+[[noreturn]] void cannotEncode(const MInstr& ins){
+    fprintf(stderr, "Cannot encode instruction: %s\n", ins.text().c_str());
+    exit(1);
+}
+
+// A label field inside an instruction: the value S + addend - P goes at
+// byte `at`, P being the field's address.
+struct Ref{
+    size_t at;
+    int32_t width;                      // 1 for short jumps, else 4
+    std::string sym;
+    int64_t addend;
+    bool call;
+};
+
+// One encoded instruction.
+class Encoding{
+    const MInstr* ins = nullptr;
+
+    // REX, opcode and ModRM (plus SIB and displacement) for reg field `reg`
+    // and the register or memory operand rm. immBytes follow the
+    // displacement, which matters for rip-relative addends. bytes: the
+    // register operands are 8-bit, where sil/dil need a REX prefix.
+    void modrm(bool w, std::initializer_list<uint8_t> opcode, int32_t reg, const MOperand& rm,
+               int32_t immBytes = 0, bool bytes = false){
+        uint8_t rex = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0);
+        bool needRex = w || (bytes && reg >= 4 && reg < 8);
+        int32_t base = -1, index = -1;
+        if(rm.kind == MOperand::Kind::Reg){
+            base = regNum(rm.reg);
+            needRex |= bytes && base >= 4 && base < 8;
+        } else if(rm.kind == MOperand::Kind::Mem){
+            if(rm.reg != PhysReg::RIP){
+                base = regNum(rm.reg);
+                if(base < 0) cannotEncode(*ins);
+            }
+            if(rm.index != PhysReg::None){
+                index = regNum(rm.index);
+                if(index & 8) rex |= 2;
+            }
+        } else {
+            cannotEncode(*ins);
+        }
+        if(base >= 0 && (base & 8)) rex |= 1;
+        if(needRex || (rex & 0x0f)){
+            b.push_back(rex);
+        }
+        b.insert(b.end(), opcode);
+        reg &= 7;
+        if(rm.kind == MOperand::Kind::Reg){
+            b.push_back(0xc0 | reg << 3 | (base & 7));
+            return;
+        }
+        if(base < 0){
+            b.push_back(0x05 | reg << 3);
+            refs.push_back({b.size(), 4, rm.sym, rm.imm - 4 - immBytes, false});
+            append(b, 0, 4);
+            return;
+        }
+        int64_t disp = rm.imm;
+        uint8_t mod = (disp == 0 && (base & 7) != 5) ? 0x00 : fitsI8(disp) ? 0x40 : 0x80;
+        if(index >= 0 || (base & 7) == 4){
+            uint8_t ss = (rm.scale == 8) ? 3 : (rm.scale == 4) ? 2 : (rm.scale == 2) ? 1 : 0;
+            b.push_back(mod | reg << 3 | 4);
+            b.push_back(ss << 6 | ((index >= 0 ? index : 4) & 7) << 3 | (base & 7));
+        } else {
+            b.push_back(mod | reg << 3 | (base & 7));
+        }
+        if(mod == 0x40) append(b, disp, 1);
+        if(mod == 0x80) append(b, disp, 4);
+    }
+    void label(const MOperand& target, int32_t width, bool call){
+        if(target.kind != MOperand::Kind::Label) cannotEncode(*ins);
+        refs.push_back({b.size(), width, target.sym, -width, call});
+        append(b, 0, width);
+    }
+    int32_t reg(const MOperand& o){
+        if(o.kind != MOperand::Kind::Reg) cannotEncode(*ins);
+        return regNum(o.reg);
+    }
+public:
+    Bytes b;
+    std::vector<Ref> refs;
+
+    Encoding() {}                       // a label: no bytes
+    // shortJump: a jump to a label uses the rel8 form
+    Encoding(const MInstr& instr, bool shortJump);
+};
+
+Encoding::Encoding(const MInstr& instr, bool shortJump) : ins(&instr){
+    const std::string& op = instr.op;
+    const std::vector<MOperand>& o = instr.opnds;
+    size_t n = o.size();
+    auto is = [&](size_t k, MOperand::Kind kind){ return k < n && o[k].kind == kind; };
+    using Kind = MOperand::Kind;
+
+    static const struct { const char* name; uint8_t ext; } alu[] = {
+        {"add", 0}, {"or", 1}, {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7},
+    };
+    for(auto& a : alu){
+        if(op != a.name) continue;
+        if(n != 2) cannotEncode(*ins);
+        bool w = o[0].size == 8;
+        if(is(1, Kind::Imm)){
+            int64_t v = o[1].imm;
+            if(fitsI8(v)){
+                modrm(w, {0x83}, a.ext, o[0], 1);
+                append(b, v, 1);
+            } else if(fitsI32(v)){
+                modrm(w, {0x81}, a.ext, o[0], 4);
+                append(b, v, 4);
+            } else {
+                cannotEncode(*ins);
+            }
+        } else if(is(1, Kind::Reg)){
+            modrm(w, {(uint8_t)(0x01 + a.ext * 8)}, reg(o[1]), o[0]);
+        } else {
+            modrm(w, {(uint8_t)(0x03 + a.ext * 8)}, reg(o[0]), o[1]);
+        }
+        return;
+    }
+    static const struct { const char* name; uint8_t ext; } shifts[] = {
+        {"shl", 4}, {"shr", 5}, {"sar", 7},
+    };
+    for(auto& s : shifts){
+        if(op != s.name) continue;
+        if(is(1, Kind::Imm) && o[1].imm == 1){
+            modrm(true, {0xd1}, s.ext, o[0]);
+        } else if(is(1, Kind::Imm)){
+            modrm(true, {0xc1}, s.ext, o[0], 1);
+            append(b, o[1].imm, 1);
+        } else if(o[1].isReg(PhysReg::RCX)){
+            modrm(true, {0xd3}, s.ext, o[0]);
+        } else {
+            cannotEncode(*ins);
+        }
+        return;
+    }
+
+    if(op == "mov"){
+        if(n != 2) cannotEncode(*ins);
+        bool w = o[0].size == 8;
+        if(is(0, Kind::Reg) && is(1, Kind::Imm) && !fitsI32(o[1].imm)){
+            // movabs
+            int32_t r = reg(o[0]);
+            b.push_back(0x48 | ((r & 8) ? 1 : 0));
+            b.push_back(0xb8 + (r & 7));
+            append(b, o[1].imm, 8);
+        } else if(is(1, Kind::Imm)){
+            if(!fitsI32(o[1].imm)) cannotEncode(*ins);
+            modrm(w, {0xc7}, 0, o[0], 4);
+            append(b, o[1].imm, 4);
+        } else if(is(1, Kind::Reg) && o[1].size == 1){
+            modrm(false, {0x88}, reg(o[1]), o[0], 0, true);
+        } else if(is(1, Kind::Reg)){
+            modrm(w, {0x89}, reg(o[1]), o[0]);
+        } else {
+            modrm(w, {0x8b}, reg(o[0]), o[1]);
+        }
+    } else if(op == "lea"){
+        if(!is(1, Kind::Mem)) cannotEncode(*ins);
+        modrm(true, {0x8d}, reg(o[0]), o[1]);
+    } else if(op == "movzx"){
+        modrm(true, {0x0f, 0xb6}, reg(o[0]), o[1], 0, true);
+    } else if(op == "movsxd"){
+        modrm(true, {0x63}, reg(o[0]), o[1]);
+    } else if(op == "imul"){
+        if(n == 1){
+            modrm(true, {0xf7}, 5, o[0]);
+        } else if(n == 2 && !is(1, Kind::Imm)){
+            modrm(true, {0x0f, 0xaf}, reg(o[0]), o[1]);
+        } else {
+            // imul r, imm is imul r, r, imm
+            const MOperand& src = (n == 3) ? o[1] : o[0];
+            int64_t v = o[n - 1].imm;
+            if(!is(n - 1, Kind::Imm) || !fitsI32(v)) cannotEncode(*ins);
+            if(fitsI8(v)){
+                modrm(true, {0x6b}, reg(o[0]), src, 1);
+                append(b, v, 1);
+            } else {
+                modrm(true, {0x69}, reg(o[0]), src, 4);
+                append(b, v, 4);
+            }
+        }
+    } else if(op == "idiv" || op == "neg"){
+        if(n != 1) cannotEncode(*ins);
+        modrm(true, {0xf7}, (op == "idiv") ? 7 : 3, o[0]);
+    } else if(op == "cqo"){
+        b = {0x48, 0x99};
+    } else if(op == "ret"){
+        b = {0xc3};
+    } else if(op == "push" || op == "pop"){
+        int32_t r = reg(o[0]);
+        if(r & 8) b.push_back(0x41);
+        b.push_back(((op == "push") ? 0x50 : 0x58) + (r & 7));
+    } else if(op.starts_with("set") && condCode(op.substr(3)) >= 0){
+        modrm(false, {0x0f, (uint8_t)(0x90 + condCode(op.substr(3)))}, 0, o[0], 0, true);
+    } else if(op == "jmp"){
+        if(is(0, Kind::Reg)){
+            modrm(false, {0xff}, 4, o[0]);
+        } else if(shortJump){
+            b.push_back(0xeb);
+            label(o[0], 1, false);
+        } else {
+            b.push_back(0xe9);
+            label(o[0], 4, !o[0].sym.starts_with(".L"));
+        }
+    } else if(op == "call"){
+        b.push_back(0xe8);
+        label(o[0], 4, true);
+    } else if(op[0] == 'j' && condCode(op.substr(1)) >= 0){
+        int32_t cc = condCode(op.substr(1));
+        if(shortJump){
+            b.push_back(0x70 + cc);
+            label(o[0], 1, false);
+        } else {
+            b = {0x0f, (uint8_t)(0x80 + cc)};
+            label(o[0], 4, false);
+        }
+    } else {
+        cannotEncode(*ins);
+    }
+}
+
+bool isJump(const MInstr& ins){
+    return ins.kind == MInstr::Kind::Op && ins.op[0] == 'j' && !ins.opnds.empty()
+        && ins.opnds[0].kind == MOperand::Kind::Label;
+}
+
+// bytes of a string literal as the assembler reads it from .string
+Bytes unescape(const std::string& s){
+    Bytes out;
+    for(size_t i = 0; i < s.size(); i++){
+        if(s[i] != '\\' || i + 1 == s.size()){
+            out.push_back(s[i]);
+            continue;
+        }
+        char c = s[++i];
+        switch(c){
+            case 'n': out.push_back('\n'); break;
+            case 't': out.push_back('\t'); break;
+            case 'r': out.push_back('\r'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'x':
+            {
+                uint32_t v = 0;
+                while(i + 1 < s.size() && isxdigit((unsigned char)s[i + 1])){
+                    char h = s[++i];
+                    v = v * 16 + (isdigit((unsigned char)h) ? h - '0' : (tolower(h) - 'a' + 10));
+                }
+                out.push_back((uint8_t)v);
+                break;
+            }
+            default:
+                if(c >= '0' && c <= '7'){
+                    uint32_t v = c - '0';
+                    for(int32_t k = 0; k < 2 && i + 1 < s.size() && s[i + 1] >= '0' && s[i + 1] <= '7'; k++){
+                        v = v * 8 + (s[++i] - '0');
+                    }
+                    out.push_back((uint8_t)v);
+                } else {
+                    out.push_back(c);
+                }
+                break;
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+void X86Encoder::add(const std::vector<MInstr>& code){
+    // split into the function body and its data
+    std::vector<const MInstr*> text, data;
+    Section section = Section::Text;
+    for(auto& ins : code){
+        if(ins.kind == MInstr::Kind::Directive){
+            if(ins.op == ".global"){
+                globals[ins.opnds[0].sym] = true;
+            } else if(ins.op == ".section"){
+                section = Section::Rodata;
+            } else if(ins.op == ".text"){
+                section = Section::Text;
+            } else {
+                data.push_back(&ins);
+            }
+            continue;
+        }
+        ((section == Section::Text) ? text : data).push_back(&ins);
+    }
+
+    // jumps to the function's own labels start short and are widened until
+    // every displacement fits in 8 bits
+    std::unordered_map<std::string, uint64_t> local;
+    for(auto ins : text){
+        if(ins->kind == MInstr::Kind::Label) local[ins->op] = 0;
+    }
+    std::vector<bool> shortJump(text.size());
+    for(size_t i = 0; i < text.size(); i++){
+        shortJump[i] = isJump(*text[i]) && local.count(text[i]->opnds[0].sym);
+    }
+    std::vector<Encoding> encoded;
+    std::vector<uint64_t> start(text.size());
+    bool changed = true;
+    while(changed){
+        encoded.clear();
+        uint64_t pos = obj.text.size();
+        for(size_t i = 0; i < text.size(); i++){
+            start[i] = pos;
+            if(text[i]->kind == MInstr::Kind::Label){
+                local[text[i]->op] = pos;
+                encoded.emplace_back();
+                continue;
+            }
+            encoded.emplace_back(*text[i], shortJump[i]);
+            pos += encoded.back().b.size();
+        }
+        changed = false;
+        for(size_t i = 0; i < text.size(); i++){
+            if(!shortJump[i]) continue;
+            int64_t disp = local[text[i]->opnds[0].sym] - (start[i] + encoded[i].b.size());
+            if(!fitsI8(disp)){
+                shortJump[i] = false;
+                changed = true;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < text.size(); i++){
+        if(text[i]->kind == MInstr::Kind::Label){
+            const std::string& name = text[i]->op;
+            labels[name] = {Section::Text, start[i]};
+            if(!name.starts_with(".L")){
+                obj.symbols.push_back({name, Section::Text, start[i], false});
+            }
+            continue;
+        }
+        Encoding& e = encoded[i];
+        for(auto& r : e.refs){
+            auto it = local.find(r.sym);
+            if(it == local.end()){
+                fixups.push_back({Section::Text, start[i] + r.at, r.sym, r.addend, r.call});
+                continue;
+            }
+            int64_t v = it->second + r.addend - (start[i] + r.at);
+            if(r.width == 1){
+                e.b[r.at] = (uint8_t)v;
+            } else {
+                put32(e.b, r.at, v);
+            }
+        }
+        obj.text.insert(obj.text.end(), e.b.begin(), e.b.end());
+    }
+
+    // jump tables
+    Bytes& ro = obj.rodata;
+    for(auto ins : data){
+        if(ins->kind == MInstr::Kind::Label){
+            labels[ins->op] = {Section::Rodata, ro.size()};
+        } else if(ins->op == ".align"){
+            while(ro.size() % ins->opnds[0].imm){
+                ro.push_back(0);
+            }
+        } else if(ins->op == ".long" && ins->opnds.size() == 2){
+            // a - b with b a label earlier in this section
+            auto base = labels.find(ins->opnds[1].sym);
+            if(base == labels.end() || base->second.section != Section::Rodata) cannotEncode(*ins);
+            fixups.push_back({Section::Rodata, ro.size(), ins->opnds[0].sym,
+                              (int64_t)(ro.size() - base->second.offset), false});
+            append(ro, 0, 4);
+        } else {
+            cannotEncode(*ins);
+        }
+    }
+}
+
+void X86Encoder::addString(const std::string& name, const std::string& literal){
+    labels[name] = {Section::Rodata, obj.rodata.size()};
+    Bytes s = unescape(literal);
+    obj.rodata.insert(obj.rodata.end(), s.begin(), s.end());
+    obj.rodata.push_back(0);
+}
+
+void X86Encoder::finish(){
+    std::unordered_set<std::string> imported;
+    for(auto& f : fixups){
+        auto it = labels.find(f.sym);
+        if(it == labels.end()){
+            // defined in another module or the standard library
+            if(imported.insert(f.sym).second){
+                obj.symbols.push_back({f.sym, Section::Undef, 0, true});
+            }
+            obj.relocs.push_back({f.section, f.offset, f.sym, Section::Undef, f.addend, f.call});
+        } else if(it->second.section != f.section){
+            obj.relocs.push_back({f.section, f.offset, "", it->second.section,
+                                  (int64_t)it->second.offset + f.addend, false});
+        } else {
+            put32(obj.bytes(f.section), f.offset, it->second.offset + f.addend - f.offset);
+        }
+    }
+    fixups.clear();
+    for(auto& s : obj.symbols){
+        if(globals.count(s.name)) s.global = true;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mir.h"
+
+/// Machine code and data of one module, the input to the object writer.
+/// Offsets are relative to the start of their section.
+class ObjectCode{
+public:
+    enum class Section : uint8_t { Undef, Text, Rodata };
+
+    class Symbol{
+    public:
+        std::string name;
+        Section section = Section::Undef;
+        uint64_t offset = 0;
+        bool global = false;
+    };
+
+    // A 32-bit field holding S + addend - P, where P is the field's address
+    // and S the named symbol or, for an empty name, the start of target.
+    class Reloc{
+    public:
+        Section section;
+        uint64_t offset;
+        std::string sym;
+        Section target;
+        int64_t addend;
+        bool call;                      // call or jmp to a function
+    };
+
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> rodata;
+    std::vector<Symbol> symbols;        // functions, defined or imported
+    std::vector<Reloc> relocs;
+
+    std::vector<uint8_t>& bytes(Section s) { return (s == Section::Text) ? text : rodata; }
+    const std::vector<uint8_t>& bytes(Section s) const { return (s == Section::Text) ? text : rodata; }
+};
+
+/// x86-64 encoder for the machine instructions the backend produces.
+/// Each function is laid out on its own: jumps to its labels start short
+/// and are widened until every displacement fits. References to other
+/// functions and to data are settled by finish(), which leaves a Reloc in
+/// the ObjectCode for whatever lies in another section or module.
+class X86Encoder{
+    struct Fixup{
+        ObjectCode::Section section;
+        uint64_t offset;                // of the 32-bit field
+        std::string sym;
+        int64_t addend;
+        bool call;
+    };
+    struct Place{
+        ObjectCode::Section section;
+        uint64_t offset;
+    };
+    ObjectCode& obj;
+    std::unordered_map<std::string, Place> labels;
+    std::unordered_map<std::string, bool> globals;
+    std::vector<Fixup> fixups;
+public:
+    X86Encoder(ObjectCode& o) : obj(o) {}
+    void add(const std::vector<MInstr>& code);
+    void addString(const std::string& name, const std::string& literal);
+    void finish();
+};
@@ -1,5 +1,8 @@
 #include "gen_ir.h"
 
+#include <algorithm>
+#include <format>
+
 IRModule& IRGenerator::run(){
 
     module.funcPool.clear();
@@ -45,7 +48,16 @@ void IRGenerator::bindImport(ASTIdx idx){
 
     auto symbols = tnlibLoader.loadTnlib(moduleName);
     for(auto& sym : symbols){
-        module.insertSymbol(sym);
+        if(sym.kind != SymbolKind::Function){
+            continue;   // parameters are kept out of scope, under their function
+        }
+        Symbol fn = sym;
+        fn.params.clear();
+        for(auto paramIdx : sym.params){
+            module.symbolPool.push_back(symbols[paramIdx]);
+            fn.params.push_back(module.symbolPool.size() - 1);
+        }
+        module.insertSymbol(fn);
     }
 }
 
@@ -58,6 +70,9 @@ void IRGenerator::bindFunc(ASTIdx idx){
     sym.setMut(false); // functions are not mutable
     sym.kind = SymbolKind::Function;
 
+    // visible in its own body, for recursion
+    SymbolIdx fnIdx = module.insertSymbol(sym);
+
     module.currentStackSize = 0;
     module.scopeIn();
 
@@ -75,12 +90,11 @@ void IRGenerator::bindFunc(ASTIdx idx){
     FuncSem& fs = module.funcSem[idx];
     fs.params = paramSyms;
 
+    module.getSymbol(fnIdx).params = paramSyms;
+
     bindStmt(node.body[0]);  // function body
     module.scopeOut();
 
-    sym.params = paramSyms;
-    module.insertSymbol(sym);
-
     module.funcSem[idx].localBytes = module.currentStackSize;
 }
 
@@ -203,8 +217,50 @@ IRFunc* IRGenerator::genFunc(ASTIdx idx){
     curFunc->params.clear();
     curFunc->params = fs.params;
 
+    // copy incoming arguments into their frame slots
+    for(size_t i = 0; i < curFunc->params.size(); i++){
+        if(i >= 6){
+            fprintf(stderr, "More than 6 parameters not supported.\n");
+            exit(1);
+        }
+        Symbol& sym = module.getSymbol(curFunc->params[i]);
+        VRegID argVid = curFunc->newVReg();
+        IRInstr param;
+        param.cmd = IRCmd::PARAM;
+        param.t = argVid;
+        param.imm = i;
+        curFunc->instrPool.push_back(param);
+
+        VRegID addrVid = curFunc->newVReg();
+        IRInstr addrInstr;
+        addrInstr.cmd = IRCmd::FRAME_ADDR;
+        addrInstr.t = addrVid;
+        addrInstr.imm = sym.stackOffset;
+        curFunc->instrPool.push_back(addrInstr);
+
+        curFunc->newIRInstr(IRCmd::SAVE, addrVid, argVid);
+    }
+
+    // self tail calls jump back here
+    bodyLabel = curFunc->newLabel();
+    IRInstr body;
+    body.cmd = IRCmd::LLABEL;
+    body.imm = bodyLabel;
+    curFunc->instrPool.push_back(body);
+
     genStmt(node.body[0]);  // function body
 
+    // falling off the end returns 0
+    if(curFunc->instrPool.empty() || 
+        (curFunc->instrPool.back().cmd != IRCmd::RET && curFunc->instrPool.back().cmd != IRCmd::JMP &&
+         curFunc->instrPool.back().cmd != IRCmd::TAILCALL)){
+        IRInstr ret;
+        ret.cmd = IRCmd::RET;
+        ret.s1 = curFunc->newVRegNum(0);
+        curFunc->instrPool.push_back(ret);
+    }
+
+    curFunc->buildCFG();
     return curFunc;
 }
 
@@ -213,6 +269,10 @@ void IRGenerator::genStmt(ASTIdx idx){
 
     switch(node.kind){
         case ASTKind::Return: {
+            if(ps.getAST(node.lhs).kind == ASTKind::FunctionCall){
+                genTailCall(node.lhs);
+                break;
+            }
             IRInstr instr;
             instr.cmd = IRCmd::RET;
             instr.s1 = genExpr(node.lhs);
@@ -226,14 +286,9 @@ void IRGenerator::genStmt(ASTIdx idx){
             break;
         }
         case ASTKind::If: {
-            VRegID condVid = genExpr(node.cond);
-
             // jump to else label if cond is zero
-            IRInstr jz;
-            jz.cmd = IRCmd::JZ;
-            jz.s1 = condVid;
-            jz.imm = curFunc->newLabel();
-            curFunc->instrPool.push_back(jz);
+            int32_t elseLabelId = curFunc->newLabel();
+            genCond(node.cond, elseLabelId, false);
 
             // then branch
             genStmt(node.thenBr);
@@ -248,7 +303,7 @@ void IRGenerator::genStmt(ASTIdx idx){
                 // else label
                 IRInstr elseLabel;
                 elseLabel.cmd = IRCmd::LLABEL;
-                elseLabel.imm = jz.imm;
+                elseLabel.imm = elseLabelId;
                 curFunc->instrPool.push_back(elseLabel);
 
                 // else branch
@@ -263,7 +318,7 @@ void IRGenerator::genStmt(ASTIdx idx){
                 // else label
                 IRInstr elseLabel;
                 elseLabel.cmd = IRCmd::LLABEL;
-                elseLabel.imm = jz.imm;
+                elseLabel.imm = elseLabelId;
                 curFunc->instrPool.push_back(elseLabel);
             }
             break;            
@@ -278,15 +333,8 @@ void IRGenerator::genStmt(ASTIdx idx){
             startLabel.imm = while_slabel;
             curFunc->instrPool.push_back(startLabel);
 
-            // condition
-            VRegID condVid = genExpr(node.cond);
-
             // jump to end label if cond is zero
-            IRInstr jz;
-            jz.cmd = IRCmd::JZ;
-            jz.s1 = condVid;
-            jz.imm = while_elabel;
-            curFunc->instrPool.push_back(jz);
+            genCond(node.cond, while_elabel, false);
 
             // currently body must have only one compound statement
             genStmt(node.body[0]);
@@ -326,6 +374,214 @@ void IRGenerator::genStmt(ASTIdx idx){
     }
 }
 
+// Switch with constant case values is dispatched through a jump table when
+// the values are dense enough, and a balanced binary search otherwise. Few
+// cases, or cases that are not literals, keep the linear compare chain.
+VRegID IRGenerator::genSwitch(ASTIdx idx){
+    ASTNode node = ps.getAST(idx);
+    VRegID retVal = curFunc->newVReg();
+    VRegID condVid = genExpr(node.cond);
+    int32_t endLabel = curFunc->newLabel();
+
+    auto emitLabel = [&](int32_t label){
+        IRInstr lbl;
+        lbl.cmd = IRCmd::LLABEL;
+        lbl.imm = label;
+        curFunc->instrPool.push_back(lbl);
+    };
+    auto emitJump = [&](int32_t label){
+        IRInstr jmp;
+        jmp.cmd = IRCmd::JMP;
+        jmp.imm = label;
+        curFunc->instrPool.push_back(jmp);
+    };
+    // case body: retVal = body; goto end
+    auto emitBody = [&](ASTIdx caseIdx){
+        VRegID caseRetVid = genExpr(ps.getAST(caseIdx).rhs);
+        curFunc->newIRInstr(IRCmd::MOV, caseRetVid, -1, retVal);
+        emitJump(endLabel);
+    };
+
+    // constant cases, first occurrence of each value wins
+    std::vector<SwitchCase> cases;
+    bool allConst = true;
+    for(size_t i = 0; i < node.body.size(); i++){
+        ASTNode caseNode = ps.getAST(node.body[i]);
+        ASTNode valNode = ps.getAST(caseNode.lhs);
+        if(valNode.kind != ASTKind::Num){
+            allConst = false;
+            break;
+        }
+        cases.push_back({valNode.val, (int32_t)i});
+    }
+    std::stable_sort(cases.begin(), cases.end(), [](auto& a, auto& b){ return a.value < b.value; });
+    cases.erase(std::unique(cases.begin(), cases.end(), [](auto& a, auto& b){ return a.value == b.value; }), cases.end());
+
+    if(!allConst || cases.size() < SWITCH_MIN_CASES){
+        // linear chain: compare with each case in turn
+        for(auto caseIdx : node.body){
+            ASTNode caseNode = ps.getAST(caseIdx);
+            VRegID caseValVid = genExpr(caseNode.lhs);
+            VRegID cmpVid = curFunc->newVReg();
+            curFunc->newIRInstr(IRCmd::EQUAL, condVid, caseValVid, cmpVid);
+
+            // jump to next case if not equal
+            IRInstr jz;
+            jz.cmd = IRCmd::JZ;
+            jz.s1 = cmpVid;
+            jz.imm = curFunc->newLabel();
+            curFunc->instrPool.push_back(jz);
+
+            emitBody(caseIdx);
+            emitLabel(jz.imm);
+        }
+    } else {
+        std::vector<int32_t> caseLabel(node.body.size(), -1);
+        for(auto& c : cases){
+            caseLabel[c.body] = curFunc->newLabel();
+        }
+        int32_t defaultLabel = curFunc->newLabel();
+
+        int64_t lo = cases.front().value;
+        int64_t range = cases.back().value - lo + 1;
+        if(range <= SWITCH_MAX_TABLE && range * 2 <= (int64_t)cases.size() * 5){
+            // jump table: at least 40% of the slots hold a case
+            VRegID index = curFunc->newVReg();
+            curFunc->newIRInstr(IRCmd::SUB, condVid, curFunc->newVRegNum(lo), index);
+            IRInstr table;
+            table.cmd = IRCmd::JTABLE;
+            table.s1 = index;
+            table.imm = defaultLabel;
+            table.labels.assign(range, defaultLabel);
+            for(auto& c : cases){
+                table.labels[c.value - lo] = caseLabel[c.body];
+            }
+            curFunc->instrPool.push_back(table);
+        } else {
+            genSwitchSearch(condVid, cases, 0, cases.size(), caseLabel, defaultLabel);
+        }
+
+        for(size_t i = 0; i < node.body.size(); i++){
+            if(caseLabel[i] < 0) continue;      // duplicate value, never reached
+            emitLabel(caseLabel[i]);
+            emitBody(node.body[i]);
+        }
+        emitLabel(defaultLabel);
+    }
+
+    // no case matched
+    curFunc->newIRInstr(IRCmd::MOV, curFunc->newVRegNum(0), -1, retVal);
+    emitLabel(endLabel);
+    return retVal;
+}
+
+// Binary search over cases[lo, hi), sorted by value.
+void IRGenerator::genSwitchSearch(VRegID cond, const std::vector<SwitchCase>& cases, size_t lo, size_t hi,
+                                  const std::vector<int32_t>& caseLabel, int32_t defaultLabel){
+    auto branch = [&](IRCmd cmp, int32_t value, int32_t label){
+        VRegID cmpVid = curFunc->newVReg();
+        curFunc->newIRInstr(cmp, cond, curFunc->newVRegNum(value), cmpVid);
+        IRInstr jnz;
+        jnz.cmd = IRCmd::JNZ;
+        jnz.s1 = cmpVid;
+        jnz.imm = label;
+        curFunc->instrPool.push_back(jnz);
+    };
+
+    if(hi - lo < SWITCH_MIN_CASES){
+        for(size_t i = lo; i < hi; i++){
+            branch(IRCmd::EQUAL, cases[i].value, caseLabel[cases[i].body]);
+        }
+        IRInstr jmp;
+        jmp.cmd = IRCmd::JMP;
+        jmp.imm = defaultLabel;
+        curFunc->instrPool.push_back(jmp);
+        return;
+    }
+
+    size_t mid = lo + (hi - lo) / 2;
+    int32_t upper = curFunc->newLabel();
+    branch(IRCmd::LE, cases[mid].value, upper);
+    genSwitchSearch(cond, cases, mid + 1, hi, caseLabel, defaultLabel);
+
+    IRInstr lbl;
+    lbl.cmd = IRCmd::LLABEL;
+    lbl.imm = upper;
+    curFunc->instrPool.push_back(lbl);
+    genSwitchSearch(cond, cases, lo, mid + 1, caseLabel, defaultLabel);
+}
+
+// `return f(...)`. A call to the function itself stores the arguments into
+// the parameter slots and jumps back to the top of the body; any other call
+// becomes a TAILCALL.
+void IRGenerator::genTailCall(ASTIdx idx){
+    ASTNode node = ps.getAST(idx);
+    SymbolIdx symIdx = module.astSymMap[idx];
+    Symbol& callee = module.getSymbol(symIdx);
+
+    std::vector<VRegID> args;
+    for(auto argIdx : node.args){
+        args.push_back(genExpr(argIdx));
+    }
+
+    if(callee.name == curFunc->fname && args.size() == curFunc->params.size()){
+        // every argument is evaluated before the first parameter is overwritten
+        for(size_t i = 0; i < args.size(); i++){
+            Symbol& param = module.getSymbol(curFunc->params[i]);
+            VRegID addrVid = curFunc->newVReg();
+            IRInstr addrInstr;
+            addrInstr.cmd = IRCmd::FRAME_ADDR;
+            addrInstr.t = addrVid;
+            addrInstr.imm = param.stackOffset;
+            curFunc->instrPool.push_back(addrInstr);
+            curFunc->newIRInstr(IRCmd::SAVE, addrVid, args[i]);
+        }
+        IRInstr jmp;
+        jmp.cmd = IRCmd::JMP;
+        jmp.imm = bodyLabel;
+        curFunc->instrPool.push_back(jmp);
+        return;
+    }
+
+    IRInstr instr;
+    instr.cmd = IRCmd::TAILCALL;
+    instr.imm = symIdx;
+    instr.args = args;
+    curFunc->instrPool.push_back(instr);
+}
+
+// Jump to label when the condition evaluates to jumpIf, fall through
+// otherwise. && and || only evaluate their right side when it decides the
+// result.
+void IRGenerator::genCond(ASTIdx idx, int32_t label, bool jumpIf){
+    ASTNode node = ps.getAST(idx);
+
+    if(node.kind == ASTKind::LogicalAnd || node.kind == ASTKind::LogicalOr){
+        // && jumps on a false left side, || on a true one
+        bool shortCircuit = (node.kind == ASTKind::LogicalOr);
+        if(shortCircuit == jumpIf){
+            genCond(node.lhs, label, jumpIf);
+            genCond(node.rhs, label, jumpIf);
+        } else {
+            int32_t skip = curFunc->newLabel();
+            genCond(node.lhs, skip, shortCircuit);
+            genCond(node.rhs, label, jumpIf);
+
+            IRInstr skipLabel;
+            skipLabel.cmd = IRCmd::LLABEL;
+            skipLabel.imm = skip;
+            curFunc->instrPool.push_back(skipLabel);
+        }
+        return;
+    }
+
+    IRInstr jmp;
+    jmp.cmd = jumpIf ? IRCmd::JNZ : IRCmd::JZ;
+    jmp.s1 = genExpr(idx);
+    jmp.imm = label;
+    curFunc->instrPool.push_back(jmp);
+}
+
 VRegID IRGenerator::genExpr(ASTIdx idx){
     ASTNode node = ps.getAST(idx);
 
@@ -370,54 +626,35 @@ VRegID IRGenerator::genExpr(ASTIdx idx){
 
             return retVid;
         }
-        case ASTKind::Switch:
+        case ASTKind::LogicalAnd:
+        case ASTKind::LogicalOr:
         {
-            VRegID retVal = curFunc->newVReg();
-            VRegID condVid = genExpr(node.cond);
+            // evaluated as control flow: the right side only runs when needed
+            VRegID t = curFunc->newVReg();
+            int32_t falseLabel = curFunc->newLabel();
             int32_t endLabel = curFunc->newLabel();
+            genCond(idx, falseLabel, false);
 
-            // condition check
-            for(auto caseIdx : node.body){
-                ASTNode caseNode = ps.getAST(caseIdx);
-                // caseNode.lhs: case value
-                // caseNode.rhs: case body
-
-                // compare condition with case value
-                VRegID caseValVid = genExpr(caseNode.lhs);
-                VRegID cmpVid = curFunc->newVReg();
-                curFunc->newIRInstr(IRCmd::EQUAL, condVid, caseValVid, cmpVid);
-
-                // jump to next case if not equal
-                IRInstr jz;
-                jz.cmd = IRCmd::JZ;
-                jz.s1 = cmpVid;
-                jz.imm = curFunc->newLabel();
-                curFunc->instrPool.push_back(jz);
-
-                // generate case body
-                VRegID caseRetVid = genExpr(caseNode.rhs);
-                // move caseRetVid to retVal
-                curFunc->newIRInstr(IRCmd::MOV, caseRetVid, -1, retVal);
-
-                // jump to end
-                IRInstr jmpEnd;
-                jmpEnd.cmd = IRCmd::JMP;
-                jmpEnd.imm = endLabel;
-                curFunc->instrPool.push_back(jmpEnd);
-
-                // next case label
-                IRInstr nextCaseLabel;
-                nextCaseLabel.cmd = IRCmd::LLABEL;
-                nextCaseLabel.imm = jz.imm;
-                curFunc->instrPool.push_back(nextCaseLabel);
-            }
-
+            curFunc->newIRInstr(IRCmd::MOV, curFunc->newVRegNum(1), -1, t);
             IRInstr jmpEnd;
-            jmpEnd.cmd = IRCmd::LLABEL;
+            jmpEnd.cmd = IRCmd::JMP;
             jmpEnd.imm = endLabel;
             curFunc->instrPool.push_back(jmpEnd);
-            return retVal;
+
+            IRInstr falseLbl;
+            falseLbl.cmd = IRCmd::LLABEL;
+            falseLbl.imm = falseLabel;
+            curFunc->instrPool.push_back(falseLbl);
+            curFunc->newIRInstr(IRCmd::MOV, curFunc->newVRegNum(0), -1, t);
+
+            IRInstr endLbl;
+            endLbl.cmd = IRCmd::LLABEL;
+            endLbl.imm = endLabel;
+            curFunc->instrPool.push_back(endLbl);
+            return t;
         }
+        case ASTKind::Switch:
+            return genSwitch(idx);
         default:
             break;
     }
@@ -456,18 +693,6 @@ VRegID IRGenerator::genExpr(ASTIdx idx){
                 curFunc->newIRInstr(IRCmd::MOD, lhs, rhs, t);
                 return t;
             }
-        case ASTKind::LogicalOr:
-            {
-                VRegID t = curFunc->newVReg();
-                curFunc->newIRInstr(IRCmd::LOGICAL_OR, lhs, rhs, t);
-                return t;
-            }
-        case ASTKind::LogicalAnd:
-            {
-                VRegID t = curFunc->newVReg();
-                curFunc->newIRInstr(IRCmd::LOGICAL_AND, lhs, rhs, t);
-                return t;
-            }
         case ASTKind::BitOr:
             {
                 VRegID t = curFunc->newVReg();
@@ -554,51 +779,6 @@ VRegID IRGenerator::genlvalue(ASTIdx idx){
 // ----------------------------------------------------------------
 // IRFunc methods
 
-void IRFunc::RegAlloc::computeUse(){
-    size_t nV = f.vregs.size();
-    lastUse.assign(nV, -1);
-    for(size_t i = 0; i < f.instrPool.size(); i++) {
-        const auto& ins = f.instrPool[i];
-        auto mark = [&](VRegID v) {
-            if(v >= 0 && (size_t)v < nV) {
-                lastUse[v] = std::max(lastUse[v], (VRegID)i);
-            }
-        };
-        mark(ins.s1);
-        mark(ins.s2);
-        mark(ins.t);
-        for(auto arg : ins.args){
-            mark(arg);
-        }
-    }
-}
-
-void IRFunc::RegAlloc::expireAt(size_t pos){
-    for(size_t vid = 0; vid < f.vregs.size(); vid++){
-        auto& vr = f.vregs[vid];
-        if(vr.assigned != PhysReg::None     // assigned to physical register
-            && lastUse[vid] >= 0            // used at least once
-            && lastUse[vid] < (VRegID)pos)          // last used before current position  
-        {
-            freeRegs.push_back(vr.assigned);
-            vr.assigned = PhysReg::None;
-        }
-    }
-}
-
-PhysReg IRFunc::RegAlloc::alloc(VRegID vid){
-    auto& vr = f.getVReg(vid);
-    if(vr.assigned != PhysReg::None) return vr.assigned;
-    if(!freeRegs.empty()){
-        PhysReg r = freeRegs.back();
-        freeRegs.pop_back();
-        vr.assigned = r;
-        return r;
-    }
-    fprintf(stderr, "No free registers available for VReg %d\n", vid);
-    exit(1);
-}
-
 void IRFunc::clean(){
     instrPool.clear();
     fname = "";
@@ -646,6 +826,25 @@ VRegID IRFunc::newVRegVar(Symbol sym){
     instrPool.push_back(instr);
     return vid;
 }
+// Give every block a label so later passes (and PHI operands) can name it,
+// then build the CFG that all passes share.
+void IRFunc::buildCFG(){
+    std::vector<IRInstr> pool;
+    pool.reserve(instrPool.size() + 16);
+    for(size_t i = 0; i < instrPool.size(); i++){
+        const IRInstr& ins = instrPool[i];
+        bool leader = (i == 0) || isTerminator(instrPool[i - 1].cmd);
+        if(leader && ins.cmd != IRCmd::LLABEL){
+            IRInstr label;
+            label.cmd = IRCmd::LLABEL;
+            label.imm = newLabel();
+            pool.push_back(label);
+        }
+        pool.push_back(ins);
+    }
+    instrPool.swap(pool);
+    cfg.build(*this);
+}
 VReg& IRFunc::getVReg(VRegID id){
     if(id < 0){
         fprintf(stderr, "VReg is not used.\n");
@@ -658,6 +857,82 @@ VReg& IRFunc::getVReg(VRegID id){
     return vregs[id];
 }
 
+uint32_t IRFunc::inlineCost() const{
+    uint32_t cost = 0;
+    for(auto& ins : instrPool){
+        switch(ins.cmd){
+            case IRCmd::LLABEL:
+            case IRCmd::MOV_IMM:
+            case IRCmd::FRAME_ADDR:
+            case IRCmd::LOAD:
+            case IRCmd::SAVE:
+            case IRCmd::PARAM:
+                break;
+            default:
+                cost++;
+        }
+    }
+    return cost;
+}
+
+// vregs labels frame count, then for each instruction
+// cmd s1 s2 t imm nargs args... nlabels labels...
+std::vector<int32_t> IRFunc::encode() const{
+    std::vector<int32_t> words = {(int32_t)vregs.size(), labelCounter, (int32_t)localStackSize, (int32_t)instrPool.size()};
+    for(auto& ins : instrPool){
+        words.insert(words.end(), {(int32_t)ins.cmd, ins.s1, ins.s2, ins.t, ins.imm});
+        words.push_back(ins.args.size());
+        words.insert(words.end(), ins.args.begin(), ins.args.end());
+        words.push_back(ins.labels.size());
+        words.insert(words.end(), ins.labels.begin(), ins.labels.end());
+    }
+    return words;
+}
+
+bool IRFunc::decode(const std::vector<int32_t>& words){
+    size_t pos = 0;
+    auto next = [&](int32_t& v){
+        if(pos >= words.size()) return false;
+        v = words[pos++];
+        return true;
+    };
+    auto vreg = [&](VRegID v){ return v >= -1 && v < (int32_t)vregs.size(); };
+
+    int32_t nV, nL, frame, nI;
+    if(!next(nV) || !next(nL) || !next(frame) || !next(nI)) return false;
+    if(nV < 0 || nL < 0 || frame < 0 || nI < 0) return false;
+    vregs.assign(nV, VReg());
+    labelCounter = nL;
+    localStackSize = frame;
+    instrPool.clear();
+    for(int32_t i = 0; i < nI; i++){
+        IRInstr ins;
+        int32_t cmd, n;
+        if(!next(cmd) || cmd < 0 || cmd > (int32_t)IRCmd::TAILCALL) return false;
+        ins.cmd = (IRCmd)cmd;
+        // their imm indexes the exporting module's symbols or strings, so
+        // the exporter never writes them
+        if(ins.cmd == IRCmd::CALL || ins.cmd == IRCmd::TAILCALL || ins.cmd == IRCmd::LEA_STRING){
+            return false;
+        }
+        if(!next(ins.s1) || !next(ins.s2) || !next(ins.t) || !next(ins.imm)) return false;
+        if(!vreg(ins.s1) || !vreg(ins.s2) || !vreg(ins.t)) return false;
+        if(!next(n) || n < 0) return false;
+        ins.args.resize(n);
+        for(auto& a : ins.args){
+            if(!next(a) || a < 0 || !vreg(a)) return false;
+        }
+        if(!next(n) || n < 0) return false;
+        ins.labels.resize(n);
+        for(auto& l : ins.labels){
+            if(!next(l) || l < 0 || l >= nL) return false;
+        }
+        if(hasLabelImm(ins.cmd) && (ins.imm < 0 || ins.imm >= nL)) return false;
+        instrPool.push_back(ins);
+    }
+    return pos == words.size();
+}
+
 // ----------------------------------------------------------------
 // IRModule methods
 
@@ -757,7 +1032,7 @@ void IRModule::outputSymbols(std::string dir, std::string module){
         exit(1);
     }
 
-    fprintf(fp, "tnlib 1\n");
+    fprintf(fp, "tnlib %d\n", TNLIB_VERSION);
     fprintf(fp, "module %s\n", module.c_str());
     for(size_t i = 0; i < symbolPool.size(); i++){
         const auto& sym = symbolPool[i];
@@ -773,16 +1048,161 @@ void IRModule::outputSymbols(std::string dir, std::string module){
                     fprintf(fp, ", ");  
                 }
             }
-            fprintf(fp, ");\n");
+            fprintf(fp, ")");
+            if(const IRFunc* body = inlineBody(sym.name)){
+                fprintf(fp, " inline {");
+                for(auto w : body->encode()){
+                    fprintf(fp, " %d", w);
+                }
+                fprintf(fp, " }");
+            }
+            fprintf(fp, ";\n");
         }
     }
     fprintf(fp, "end\n");
     fclose(fp);
 }
 
+// Body of a function defined here that importers may inline: small, and
+// free of calls and string literals, whose symbols only exist in this module.
+const IRFunc* IRModule::inlineBody(const std::string& name) const{
+    for(auto& func : funcPool){
+        if(func.fname != name) continue;
+        if(func.inlineCost() > INLINE_EXPORT_MAX) return nullptr;
+        for(auto& ins : func.instrPool){
+            if(ins.cmd == IRCmd::CALL || ins.cmd == IRCmd::TAILCALL || ins.cmd == IRCmd::LEA_STRING){
+                return nullptr;
+            }
+        }
+        return &func;
+    }
+    return nullptr;
+}
+
 void IRModule::printSymbols(){
     for(size_t i = 0; i < symbolPool.size(); i++){
         const auto& sym = symbolPool[i];
         std::cout << "Symbol[" << i << "]: " << sym.name << ", mut=" << sym.isMut() << "\n";
     }
 }
+
+static const char* irCmdName(IRCmd cmd){
+    switch(cmd){
+        case IRCmd::ADD: return "add";
+        case IRCmd::SUB: return "sub";
+        case IRCmd::MUL: return "mul";
+        case IRCmd::DIV: return "div";
+        case IRCmd::MOD: return "mod";
+        case IRCmd::BIT_XOR: return "xor";
+        case IRCmd::BIT_OR: return "or";
+        case IRCmd::BIT_AND: return "and";
+        case IRCmd::EQUAL: return "eq";
+        case IRCmd::NEQUAL: return "ne";
+        case IRCmd::LT: return "lt";
+        case IRCmd::LE: return "le";
+        case IRCmd::LSHIFT: return "shl";
+        case IRCmd::RSHIFT: return "shr";
+        case IRCmd::MOV: return "mov";
+        case IRCmd::MOV_IMM: return "mov";
+        case IRCmd::RET: return "ret";
+        case IRCmd::LOAD: return "load";
+        case IRCmd::SAVE: return "save";
+        case IRCmd::FRAME_ADDR: return "frame_addr";
+        case IRCmd::LLABEL: return "label";
+        case IRCmd::JZ: return "jz";
+        case IRCmd::JNZ: return "jnz";
+        case IRCmd::JMP: return "jmp";
+        case IRCmd::CALL: return "call";
+        case IRCmd::TAILCALL: return "tailcall";
+        case IRCmd::LEA_STRING: return "lea_string";
+        case IRCmd::RELOAD: return "reload";
+        case IRCmd::SPILL: return "spill";
+        case IRCmd::PARAM: return "param";
+        case IRCmd::PHI: return "phi";
+        case IRCmd::JEQ: return "jeq";
+        case IRCmd::JNE: return "jne";
+        case IRCmd::JLT: return "jlt";
+        case IRCmd::JLE: return "jle";
+        case IRCmd::JGT: return "jgt";
+        case IRCmd::JGE: return "jge";
+        case IRCmd::JTABLE: return "jtable";
+    }
+    return "?";
+}
+
+// One instruction in a compact "v3 = add v1, v2" form, used by the dumps.
+std::string IRModule::instrString(const IRInstr& ins) const{
+    std::string s;
+    auto out = std::back_inserter(s);
+    switch(ins.cmd){
+        case IRCmd::LLABEL:
+            std::format_to(out, "L{}:", ins.imm);
+            return s;
+        case IRCmd::JMP:
+            std::format_to(out, "jmp L{}", ins.imm);
+            return s;
+        case IRCmd::JZ:
+        case IRCmd::JNZ:
+            std::format_to(out, "{} v{}, L{}", irCmdName(ins.cmd), ins.s1, ins.imm);
+            return s;
+        case IRCmd::JEQ:
+        case IRCmd::JNE:
+        case IRCmd::JLT:
+        case IRCmd::JLE:
+        case IRCmd::JGT:
+        case IRCmd::JGE:
+            std::format_to(out, "{} v{}, v{}, L{}", irCmdName(ins.cmd), ins.s1, ins.s2, ins.imm);
+            return s;
+        case IRCmd::JTABLE:
+            std::format_to(out, "jtable v{}, [", ins.s1);
+            for(size_t k = 0; k < ins.labels.size(); k++){
+                std::format_to(out, "{}L{}", k ? ", " : "", ins.labels[k]);
+            }
+            std::format_to(out, "], L{}", ins.imm);
+            return s;
+        default:
+            break;
+    }
+
+    if(ins.t >= 0){
+        std::format_to(out, "v{} = ", ins.t);
+    }
+    s += irCmdName(ins.cmd);
+    const char* sep = " ";
+    switch(ins.cmd){
+        case IRCmd::CALL:
+        case IRCmd::TAILCALL:
+            std::format_to(out, " {}", symbolPool[ins.imm].name);
+            break;
+        case IRCmd::MOV_IMM:
+        case IRCmd::FRAME_ADDR:
+        case IRCmd::LEA_STRING:
+        case IRCmd::RELOAD:
+        case IRCmd::PARAM:
+            std::format_to(out, " {}", ins.imm);
+            sep = ", ";
+            break;
+        default:
+            break;
+    }
+    if(ins.s1 >= 0){
+        std::format_to(out, "{}v{}", sep, ins.s1);
+        sep = ", ";
+    }
+    if(ins.s2 >= 0){
+        std::format_to(out, "{}v{}", sep, ins.s2);
+        sep = ", ";
+    }
+    for(size_t k = 0; k < ins.args.size(); k++){
+        if(ins.cmd == IRCmd::PHI){
+            std::format_to(out, "{}[v{}, L{}]", sep, ins.args[k], ins.labels[k]);
+        } else {
+            std::format_to(out, "{}v{}", sep, ins.args[k]);
+        }
+        sep = ", ";
+    }
+    if(ins.cmd == IRCmd::SPILL){
+        std::format_to(out, "{}{}", sep, ins.imm);
+    }
+    return s;
+}
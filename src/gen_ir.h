@@ -9,9 +9,16 @@
 #include "symbol.h"
 #include "parse.h"
 #include "tnlib_loader.h"
+#include "cfg.h"
 
-enum class PhysReg : uint8_t { None, R10, R11, R12, R13, R14, R15, RAX, RDI, RSI, RDX, RCX, R8, R9 };
-enum class VRegKind : uint8_t { Temp, Imm, LVarAddr };
+enum class PhysReg : uint8_t {
+    None, R10, R11, R12, R13, R14, R15, RAX, RDI, RSI, RDX, RCX, R8, R9,
+    RBP, RSP, RIP,          // frame and addressing only, never allocated
+};
+// Temp lives in a register; Imm (a constant), LVarAddr (a frame slot address)
+// and Slot (a spilled value at [rbp - val]) are folded into the instructions
+// using them by instruction selection and never get a register.
+enum class VRegKind : uint8_t { Temp, Imm, LVarAddr, Slot };
 
 class VReg{
 public:
@@ -22,14 +29,15 @@ public:
 
 
 
+// IRFunc::encode writes these values as they are into .tnlib inline
+// bodies: reordering or inserting commands changes the file format, so
+// bump TNLIB_VERSION (tnlib_loader.h) with it.
 enum class IRCmd {
     ADD,
     SUB,
     MUL,
     DIV,
     MOD,
-    LOGICAL_OR,
-    LOGICAL_AND,
     BIT_XOR,
     BIT_OR,
     BIT_AND,
@@ -51,8 +59,46 @@ enum class IRCmd {
     JMP,            // unconditional jmp
     CALL,
     LEA_STRING,
+    RELOAD,         // load spilled value from frame slot
+    SPILL,          // store value to frame slot
+    PARAM,          // t = incoming argument #imm
+    PHI,            // t = args[k] when entered from block labels[k]
+    JEQ,            // jmp if s1 == s2 (compare fused with JZ/JNZ by ISel)
+    JNE,
+    JLT,
+    JLE,
+    JGT,
+    JGE,
+    JTABLE,         // jmp labels[s1] if 0 <= s1 < labels.size(), else imm
+    TAILCALL,       // return imm(args...): the frame is released and the callee returns for us
 };
 
+inline bool isCondBranch(IRCmd cmd){
+    switch(cmd){
+        case IRCmd::JZ:
+        case IRCmd::JNZ:
+        case IRCmd::JEQ:
+        case IRCmd::JNE:
+        case IRCmd::JLT:
+        case IRCmd::JLE:
+        case IRCmd::JGT:
+        case IRCmd::JGE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline bool isTerminator(IRCmd cmd){
+    return cmd == IRCmd::RET || cmd == IRCmd::TAILCALL || cmd == IRCmd::JMP || cmd == IRCmd::JTABLE ||
+           isCondBranch(cmd);
+}
+
+// imm holds a label
+inline bool hasLabelImm(IRCmd cmd){
+    return cmd == IRCmd::LLABEL || cmd == IRCmd::JMP || cmd == IRCmd::JTABLE || isCondBranch(cmd);
+}
+
 class IRInstr{
 public:
     IRCmd cmd;
@@ -61,33 +107,66 @@ public:
     VRegID t = -1;
     int32_t imm = 0;
     std::vector<VRegID> args;
+    std::vector<int32_t> labels;
 };
 
+class MFunction;
+
 class IRFunc{
     friend class IRGenerator;
     friend class X86Generator;
     friend class RegAlloc;
+    friend class CFG;
+    friend class Mem2Reg;
+    friend class PhiElim;
+    friend class SCCP;
+    friend class ISel;
+    friend class Inliner;
+    friend class DCE;
+    friend class GVN;
+    friend class LICM;
+    friend class StrengthReduce;
+    friend class IRVerifier;
+    friend class IRModule;
     std::vector<IRInstr> instrPool;
     std::vector<VReg> vregs;
     std::vector<SymbolIdx> params;
     int32_t labelCounter = 0;
+    CFG cfg;
 
+    // Linear-scan register allocator.
+    // Live intervals come from a liveness analysis over the CFG, so values
+    // flowing around loops stay live for the whole loop. When registers run
+    // out the interval ending furthest away is spilled to a frame slot and
+    // every use/def is rewritten through a short reload/spill vreg.
     class RegAlloc{
-        std::vector<PhysReg> freeRegs;
-        std::vector<VRegID> lastUse;
+        struct Interval{
+            VRegID vid;
+            int32_t start;
+            int32_t end;
+            uint32_t forbidden;     // registers clobbered somewhere in the interval
+        };
+        std::vector<Interval> intervals;    // sorted by start
+        std::vector<size_t> dyingBegin;     // dyingList[dyingBegin[p]..dyingBegin[p+1]) end at p
+        std::vector<size_t> dyingList;      // indices into intervals
+        size_t expirePos = 0;
+        int32_t regOwner[16];               // interval holding each PhysReg, -1 if free
+        std::vector<bool> unspillable;      // reload/spill temporaries
+        std::vector<bool> spilled;
+        uint32_t freeRegs = 0;
         IRFunc& f;
+
+        void expireAt(int32_t pos);
+        bool alloc(size_t idx);
+        void rewriteSpills();
     public:
-        RegAlloc(IRFunc& func) : f(func) {
-            freeRegs = {PhysReg::R10, PhysReg::R11, PhysReg::R12, PhysReg::R13, PhysReg::R14, PhysReg::R15};
-        }
+        RegAlloc(IRFunc& func) : f(func) {}
+        void run();
         void computeUse();
-
-        void expireAt(size_t pos);
-
-        PhysReg alloc(VRegID vid);
+        PhysReg reg(VRegID vid);
+        void rewrite(MFunction& mf);        // virtual operands -> registers and slots
     };
 
-    RegAlloc regAlloc{*this};
 public:
     uint32_t localStackSize = 0;
     void clean();
@@ -99,6 +178,15 @@ public:
     VRegID newVRegNum(int32_t val);
     VRegID newVRegVar(Symbol sym);
     VReg& getVReg(VRegID id);
+    void buildCFG();
+    const CFG& getCFG() const { return cfg; }
+
+    // instructions left once locals live in vregs and constants are folded,
+    // the inliner's size measure
+    uint32_t inlineCost() const;
+    // flat form of the IR written to .tnlib for cross-module inlining
+    std::vector<int32_t> encode() const;
+    bool decode(const std::vector<int32_t>& words);
 };
 
 class Scope{
@@ -160,12 +248,29 @@ public:
 
     void outputSymbols(std::string dir, std::string module);
 
+    const IRFunc* inlineBody(const std::string& name) const;
+
+    std::string instrString(const IRInstr& ins) const;
+
     void printSymbols();
 };
 
+// largest inlineCost() of a body exported in .tnlib
+constexpr uint32_t INLINE_EXPORT_MAX = 40;
+
+// switch lowering thresholds
+constexpr size_t SWITCH_MIN_CASES = 4;      // fewer cases use a compare chain
+constexpr int64_t SWITCH_MAX_TABLE = 4096;  // largest jump table
+
+struct SwitchCase{
+    int32_t value;
+    int32_t body;       // index of the case in the switch
+};
+
 class IRGenerator{
 private:
     IRFunc* curFunc;
+    int32_t bodyLabel = -1;     // start of curFunc after the parameters are stored
     void bindTU(ASTIdx idx);
     void bindImport(ASTIdx idx);
     void bindFunc(ASTIdx idx);
@@ -173,6 +278,11 @@ private:
     void bindExpr(ASTIdx idx);
     IRFunc* genFunc(ASTIdx idx);
     void genStmt(ASTIdx idx);
+    void genCond(ASTIdx idx, int32_t label, bool jumpIf);
+    void genTailCall(ASTIdx idx);
+    VRegID genSwitch(ASTIdx idx);
+    void genSwitchSearch(VRegID cond, const std::vector<SwitchCase>& cases, size_t lo, size_t hi,
+                         const std::vector<int32_t>& caseLabel, int32_t defaultLabel);
     VRegID genExpr(ASTIdx idx);
     VRegID genlvalue(ASTIdx idx);
 
@@ -1,43 +1,52 @@
 #include "gen_x86-64.h"
+#include "isel.h"
+#include "mir.h"
+#include "encode_x86-64.h"
 
-inline const char* regName(PhysReg r) {
-    switch(r) {
-        case PhysReg::R10: return "r10";
-        case PhysReg::R11: return "r11";
-        case PhysReg::R12: return "r12";
-        case PhysReg::R13: return "r13";
-        case PhysReg::R14: return "r14";
-        case PhysReg::R15: return "r15";
-        case PhysReg::RAX: return "rax";
-        case PhysReg::RDI: return "rdi";
-        case PhysReg::RSI: return "rsi";
-        case PhysReg::RDX: return "rdx";
-        case PhysReg::RCX: return "rcx";
-        case PhysReg::R8:  return "r8";
-        case PhysReg::R9:  return "r9";
-        default: return "none";
-    }
+#include <algorithm>
+
+namespace {
+
+// Multiplier and shift for signed division by d >= 2 as a high multiply,
+// after Hacker's Delight 10-1: q = (mulhi(x, mul) [+ x]) >> shift, plus one
+// when negative.
+struct Magic{
+    int64_t mul;
+    int32_t shift;
+};
+
+Magic signedMagic(uint64_t d){
+    const uint64_t two63 = 1ull << 63;
+    uint64_t anc = two63 - 1 - two63 % d;      // |nc|
+    int32_t p = 63;
+    uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+    uint64_t q2 = two63 / d, r2 = two63 - q2 * d;
+    uint64_t delta;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if(r1 >= anc){
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if(r2 >= d){
+            q2++;
+            r2 -= d;
+        }
+        delta = d - r2;
+    } while(q1 < delta || (q1 == delta && r1 == 0));
+    return {(int64_t)(q2 + 1), p - 64};
 }
 
-inline const char* regName8(PhysReg r) {
-    switch(r) {
-        case PhysReg::R10: return "r10b";
-        case PhysReg::R11: return "r11b";
-        case PhysReg::R12: return "r12b";
-        case PhysReg::R13: return "r13b";
-        case PhysReg::R14: return "r14b";
-        case PhysReg::R15: return "r15b";
-        case PhysReg::RAX: return "al";
-        case PhysReg::RDI: return "dil";
-        case PhysReg::RSI: return "sil";
-        case PhysReg::RDX: return "dl";
-        case PhysReg::RCX: return "cl";
-        case PhysReg::R8:  return "r8b";
-        case PhysReg::R9:  return "r9b";
-        default: return "none";
-    }
+bool isPow2(uint64_t v){
+    return v != 0 && (v & (v - 1)) == 0;
 }
 
+} // namespace
+
 void X86Generator::emit(){
     out.print(".intel_syntax noprefix\n");
 
@@ -45,8 +54,22 @@ void X86Generator::emit(){
 
     out.print(".text\n");
     for(auto& func : irm.funcPool){
-        emitFunc(func);
+        MFunction mf = compileFunc(func);
+        for(auto& ins : mf.code){
+            out.print("{}\n", ins.text());
+        }
+    }
+}
+
+void X86Generator::emitObject(ObjectCode& obj){
+    X86Encoder enc(obj);
+    for(auto& sld : irm.stringLiterals){
+        enc.addString(std::format(".LC{}", sld.id), sld.str);
+    }
+    for(auto& func : irm.funcPool){
+        enc.add(compileFunc(func).code);
     }
+    enc.finish();
 }
 
 void X86Generator::emitStringLiterals(){
@@ -58,284 +81,296 @@ void X86Generator::emitStringLiterals(){
         out.print("  .string \"{}\"\n", sld.str);
     }
 }
-void X86Generator::emitFunc(IRFunc& func){
-    func.regAlloc.computeUse();
-    
-    out.print(".global {}\n", func.fname);
-    out.print("{}:\n", func.fname);
-    out.print("  push rbp\n");
-    out.print("  mov rbp, rsp\n");
-    // Ensure 16-byte alignment for the stack within this function.
-    // At function entry (after the caller's call), rsp is 8 bytes off 16.
-    // push rbp -> rsp becomes 16-byte aligned. Keep it aligned by subtracting
-    // a multiple of 16 here so that before emitting any call, rsp stays 16-aligned.
-    uint32_t alignedLocal = (func.localStackSize + 15) & ~15u; // round up to 16
-    out.print("  sub rsp, {}\n", alignedLocal);
+// everything between the optimized IR and the final machine code
+MFunction X86Generator::compileFunc(IRFunc& func){
+    ISel(func).run();
+    IRFunc::RegAlloc regAlloc(func);
+    regAlloc.run();
 
-    for(size_t i = 0; i < func.params.size(); i++){
-        SymbolIdx symIdx = func.params[i];
-        Symbol& sym = irm.getSymbol(symIdx);
-        PhysReg paramReg;
-        switch(i){
-            case 0: paramReg = PhysReg::RDI; break;
-            case 1: paramReg = PhysReg::RSI; break;
-            case 2: paramReg = PhysReg::RDX; break;
-            case 3: paramReg = PhysReg::RCX; break;
-            case 4: paramReg = PhysReg::R8;  break;
-            case 5: paramReg = PhysReg::R9;  break;
-            default:
-                fprintf(stderr, "More than 6 parameters not supported.\n");
-                exit(1);
-        }
-        out.print("  mov [rbp - {}], {}\n", sym.stackOffset, regName(paramReg));
-    }
+    MFunction mf = lower(func);
+    regAlloc.rewrite(mf);
+    FrameLowering(mf).run();
+    Peephole(mf.code).run();
+    return mf;
+}
 
-    out.print("  push r12\n");
-    out.print("  push r13\n");
-    out.print("  push r14\n");
-    out.print("  push r15\n");
+// IR after register allocation -> machine code. Values stay virtual
+// registers; their kind only decides between register, immediate and
+// memory forms.
+MFunction X86Generator::lower(IRFunc& func){
+    MFunction mf;
+    mf.name = func.fname;
+    mf.frameSize = func.localStackSize;
+    std::vector<MInstr>& code = mf.code;
+    auto emit = [&](const char* op, std::initializer_list<MOperand> opnds = {}){
+        code.push_back({MInstr::Kind::Op, op, opnds});
+    };
+    auto R = [](PhysReg r){ return MOperand::r(r); };
+    auto V = [](VRegID v, uint8_t size = 8){ return MOperand::v(v, size); };
+    auto I = [](int64_t v){ return MOperand::i(v); };
+    auto blockLabel = [&](int32_t label){ return std::format(".L{}{}", func.fname, label); };
+    std::string retLabel = std::format("ret_{}", func.fname);
 
-    for(auto& instr : func.instrPool){
-        func.regAlloc.expireAt(&instr - &func.instrPool[0]);
-        switch(instr.cmd){
-            case IRCmd::RET:
-            {
-                PhysReg r = func.regAlloc.alloc(instr.s1);
-                if(r != PhysReg::RAX){
-                    out.print("  mov rax, {}\n", regName(r));
-                }
-                out.print("  jmp ret_{}\n", func.fname);
-                break;
-            }
-            case IRCmd::ADD:
-            {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(rt != r1){
-                    out.print("  mov {}, {}\n", regName(rt), regName(r1));
-                }
-                out.print("  add {}, {}\n", regName(rt), regName(r2));
-                break;
-            }
-            case IRCmd::SUB:
-            {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(rt != r1){
-                    out.print("  mov {}, {}\n", regName(rt), regName(r1));
-                }
-                out.print("  sub {}, {}\n", regName(rt), regName(r2));
-                break;
+    // register, immediate or [rbp - N] operand
+    auto opnd = [&](VRegID vid) -> MOperand {
+        VReg& vr = func.getVReg(vid);
+        switch(vr.kind){
+            case VRegKind::Imm:
+                return I(vr.val);
+            case VRegKind::LVarAddr:
+                return MOperand::m(PhysReg::RBP, -(int64_t)vr.val);
+            default:
+                return V(vid);
+        }
+    };
+    // Signed division by a constant other than 0 and -1 without idiv,
+    // rounding toward zero like idiv. rax and rdx are scratch; returns the
+    // register holding the quotient (or the remainder for mod).
+    auto divByConst = [&](VRegID s1, int64_t d, bool mod) -> PhysReg {
+        MOperand x = opnd(s1);
+        MOperand rax = R(PhysReg::RAX), rdx = R(PhysReg::RDX);
+        uint64_t ad = (d < 0) ? -(uint64_t)d : (uint64_t)d;
+        if(ad == 1){
+            if(mod){
+                emit("mov", {rdx, I(0)});
+                return PhysReg::RDX;
             }
-            case IRCmd::MUL:
-            {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(rt != r1){
-                    out.print("  mov {}, {}\n", regName(rt), regName(r1));
-                }
-                out.print("  imul {}, {}\n", regName(rt), regName(r2));
-                break;
+            emit("mov", {rax, x});
+            return PhysReg::RAX;
+        }
+        if(isPow2(ad)){
+            // negative dividends are biased by ad - 1 before the shift
+            int32_t k = __builtin_ctzll(ad);
+            emit("mov", {rax, x});
+            emit("mov", {rdx, rax});
+            if(k > 1){
+                emit("sar", {rdx, I(63)});
             }
-            case IRCmd::DIV:
-            {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(r1 != PhysReg::RAX){
-                    out.print("  mov rax, {}\n", regName(r1));
-                }
-                out.print("  cqo\n");
-                out.print("  idiv {}\n", regName(r2));
-                if(rt != PhysReg::RAX){
-                    out.print("  mov {}, rax\n", regName(rt));
-                }
-                break;
+            emit("shr", {rdx, I(64 - k)});
+            emit("add", {rax, rdx});
+            if(mod){
+                emit("and", {rax, I(-(int64_t)ad)});
+                emit("mov", {rdx, x});
+                emit("sub", {rdx, rax});
+                return PhysReg::RDX;
             }
-            case IRCmd::MOD:
-            {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(r1 != PhysReg::RAX){
-                    out.print("  mov rax, {}\n", regName(r1));
-                }
-                out.print("  cqo\n");
-                out.print("  idiv {}\n", regName(r2));
-                out.print("  mov {}, rdx\n", regName(rt));
-                break;
+            emit("sar", {rax, I(k)});
+            if(d < 0){
+                emit("neg", {rax});
             }
-            case IRCmd::LOGICAL_OR:
-            {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                out.print("  cmp {}, 0\n", regName(r1));
-                out.print("  setne al\n");
-                out.print("  cmp {}, 0\n", regName(r2));
-                out.print("  setne cl\n");
-                out.print("  or al, cl\n");
-                out.print("  movzx {}, al\n", regName(rt));
-                break;
-            }
-            case IRCmd::LOGICAL_AND:
+            return PhysReg::RAX;
+        }
+        Magic m = signedMagic(ad);
+        emit("mov", {rax, I(m.mul)});
+        emit("imul", {x});
+        if(m.mul < 0){
+            emit("add", {rdx, x});
+        }
+        if(m.shift > 0){
+            emit("sar", {rdx, I(m.shift)});
+        }
+        emit("mov", {rax, rdx});
+        emit("shr", {rax, I(63)});
+        emit("add", {rdx, rax});
+        if(mod){
+            emit("imul", {rdx, rdx, I(ad)});
+            emit("mov", {rax, x});
+            emit("sub", {rax, rdx});
+            return PhysReg::RAX;
+        }
+        if(d < 0){
+            emit("neg", {rdx});
+        }
+        return PhysReg::RDX;
+    };
+    // rt = x * c with shl / lea for c = {1, 3, 5, 9} * 2^k; false if imul is
+    // as good
+    auto mulByConst = [&](VRegID t, VRegID x, int64_t c) -> bool {
+        if(c <= 0) return false;
+        int32_t k = __builtin_ctzll(c);
+        int64_t base = c >> k;
+        if(base != 1 && base != 3 && base != 5 && base != 9) return false;
+        VRegID src = t;
+        if(base == 1 || func.getVReg(x).kind != VRegKind::Temp){
+            emit("mov", {V(t), opnd(x)});
+        } else {
+            src = x;
+        }
+        if(base != 1){
+            MOperand addr = MOperand::mv(src, 0, 0);
+            addr.vindex = src;
+            addr.scale = base - 1;
+            emit("lea", {V(t), addr});
+        }
+        if(k > 0){
+            emit("shl", {V(t), I(k)});
+        }
+        return true;
+    };
+    // JTABLE label lists, emitted after the function body
+    std::vector<const std::vector<int32_t>*> tables;
+    // memory addressed by a LOAD/SAVE address operand
+    auto addrOpnd = [&](VRegID vid) -> MOperand {
+        if(func.getVReg(vid).kind == VRegKind::LVarAddr){
+            return opnd(vid);
+        }
+        return MOperand::mv(vid, 0);
+    };
+
+    code.push_back(MInstr::directive(".global", {MOperand::label(func.fname)}));
+    code.push_back(MInstr::label(func.fname));
+
+    for(auto& instr : func.instrPool){
+        const Pattern& pat = patternOf(instr.cmd);
+        switch(pat.form){
+            case Form::BinOp:
             {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                out.print("  cmp {}, 0\n", regName(r1));
-                out.print("  setne al\n");
-                out.print("  cmp {}, 0\n", regName(r2));
-                out.print("  setne cl\n");
-                out.print("  and al, cl\n");
-                out.print("  movzx {}, al\n", regName(rt));
-                break;
+                MOperand rt = V(instr.t);
+                emit("mov", {rt, opnd(instr.s1)});
+                emit(pat.op, {rt, opnd(instr.s2)});
+                continue;
             }
-            case IRCmd::BIT_OR:
+            case Form::Shift:
             {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(rt != r1){
-                    out.print("  mov {}, {}\n", regName(rt), regName(r1));
+                MOperand rt = V(instr.t);
+                emit("mov", {rt, opnd(instr.s1)});
+                VReg& count = func.getVReg(instr.s2);
+                if(count.kind == VRegKind::Imm){
+                    emit(pat.op, {rt, I(count.val & 63)});
+                } else {
+                    emit("mov", {MOperand::r(PhysReg::RCX, 1), V(instr.s2, 1)});
+                    emit(pat.op, {rt, MOperand::r(PhysReg::RCX, 1)});
                 }
-                out.print("  or {}, {}\n", regName(rt), regName(r2));
-                break;
+                continue;
             }
-            case IRCmd::BIT_XOR:
+            case Form::Compare:
             {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(rt != r1){
-                    out.print("  mov {}, {}\n", regName(rt), regName(r1));
+                MOperand rt = V(instr.t);
+                VRegID a = instr.s1, b = instr.s2;
+                std::string cc = pat.op;
+                if(func.getVReg(a).kind == VRegKind::Imm){
+                    std::swap(a, b);
+                    cc = pat.swappedOp;
                 }
-                out.print("  xor {}, {}\n", regName(rt), regName(r2));
-                break;
+                emit("cmp", {opnd(a), opnd(b)});
+                code.push_back({MInstr::Kind::Op, "set" + cc, {V(instr.t, 1)}});
+                emit("movzx", {rt, V(instr.t, 1)});
+                continue;
             }
-            case IRCmd::BIT_AND:
+            case Form::Branch:
             {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(rt != r1){
-                    out.print("  mov {}, {}\n", regName(rt), regName(r1));
+                VRegID a = instr.s1, b = instr.s2;
+                std::string cc = pat.op;
+                if(func.getVReg(a).kind == VRegKind::Imm){
+                    std::swap(a, b);
+                    cc = pat.swappedOp;
                 }
-                out.print("  and {}, {}\n", regName(rt), regName(r2));
-                break;
-            }
-            case IRCmd::EQUAL:
-            {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                out.print("  cmp {}, {}\n", regName(r1), regName(r2));
-                out.print("  sete al\n");
-                out.print("  movzx {}, al\n", regName(rt));
-                break;
-            }
-            case IRCmd::NEQUAL:
-            {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                out.print("  cmp {}, {}\n", regName(r1), regName(r2));
-                out.print("  setne al\n");
-                out.print("  movzx {}, al\n", regName(rt));
-                break;
+                emit("cmp", {opnd(a), opnd(b)});
+                code.push_back({MInstr::Kind::Op, "j" + cc, {MOperand::label(blockLabel(instr.imm))}});
+                continue;
             }
-            case IRCmd::LT:
-            {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                out.print("  cmp {}, {}\n", regName(r1), regName(r2));
-                out.print("  setl al\n");
-                out.print("  movzx {}, al\n", regName(rt));
+            case Form::Special:
                 break;
-            }
-            case IRCmd::LE:
+        }
+
+        switch(instr.cmd){
+            case IRCmd::RET:
             {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                out.print("  cmp {}, {}\n", regName(r1), regName(r2));
-                out.print("  setle al\n");
-                out.print("  movzx {}, al\n", regName(rt));
+                // the jump to the epilogue right behind the last RET is
+                // dropped by the peephole pass
+                emit("mov", {R(PhysReg::RAX), opnd(instr.s1)});
+                emit("jmp", {MOperand::label(retLabel)});
                 break;
             }
-            case IRCmd::LSHIFT:
+            case IRCmd::MUL:
             {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(rt != r1){
-                    out.print("  mov {}, {}\n", regName(rt), regName(r1));
+                MOperand rt = V(instr.t);
+                VRegID a = instr.s1, b = instr.s2;
+                if(func.getVReg(a).kind == VRegKind::Imm){
+                    std::swap(a, b);
+                }
+                VReg& c = func.getVReg(b);
+                if(c.kind == VRegKind::Imm && mulByConst(instr.t, a, c.val)){
+                    break;
                 }
-                out.print("  mov cl, {}\n", regName8(r2));
-                out.print("  shl {}, cl\n", regName(rt));
+                emit("mov", {rt, opnd(instr.s1)});
+                emit("imul", {rt, opnd(instr.s2)});
                 break;
             }
-            case IRCmd::RSHIFT:
+            case IRCmd::DIV:
+            case IRCmd::MOD:
             {
-                PhysReg r1 = func.regAlloc.alloc(instr.s1);
-                PhysReg r2 = func.regAlloc.alloc(instr.s2);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                if(rt != r1){
-                    out.print("  mov {}, {}\n", regName(rt), regName(r1));
+                MOperand rt = V(instr.t);
+                PhysReg result;
+                VReg& divisor = func.getVReg(instr.s2);
+                if(divisor.kind == VRegKind::Imm){
+                    result = divByConst(instr.s1, divisor.val, instr.cmd == IRCmd::MOD);
+                } else {
+                    emit("mov", {R(PhysReg::RAX), opnd(instr.s1)});
+                    emit("cqo");
+                    emit("idiv", {opnd(instr.s2)});
+                    result = (instr.cmd == IRCmd::DIV) ? PhysReg::RAX : PhysReg::RDX;
                 }
-                out.print("  mov cl, {}\n", regName8(r2));
-                out.print("  shr {}, cl\n", regName(rt));
+                emit("mov", {rt, R(result)});
                 break;
             }
             case IRCmd::FRAME_ADDR:
             {
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                out.print("  lea {}, [rbp - {}]\n", regName(rt), instr.imm);
+                emit("lea", {V(instr.t), MOperand::m(PhysReg::RBP, -(int64_t)instr.imm, 0)});
                 break;
             }
             case IRCmd::LOAD:
             {
-                PhysReg rAddr = func.regAlloc.alloc(instr.s1);
-                PhysReg rt = func.regAlloc.alloc(instr.t);
-                out.print("  mov {}, [{}]\n", regName(rt), regName(rAddr));
+                emit("mov", {V(instr.t), addrOpnd(instr.s1)});
                 break;
             }
             case IRCmd::SAVE:
             {
-                PhysReg rAddr = func.regAlloc.alloc(instr.s1);
-                PhysReg rVal = func.regAlloc.alloc(instr.s2);
-                out.print("  mov [{}], {}\n", regName(rAddr), regName(rVal));
+                emit("mov", {addrOpnd(instr.s1), opnd(instr.s2)});
                 break;
             }
             case IRCmd::LLABEL:
             {
-                out.print(".L{}{}:\n", func.fname, instr.imm);
+                code.push_back(MInstr::label(blockLabel(instr.imm)));
                 break;
             }
             case IRCmd::JMP:
             {
-                out.print("  jmp .L{}{}\n", func.fname, instr.imm);
+                emit("jmp", {MOperand::label(blockLabel(instr.imm))});
+                break;
+            }
+            case IRCmd::JTABLE:
+            {
+                // unsigned compare also sends negative indices to the default
+                MOperand idx = V(instr.s1);
+                MOperand table = MOperand::m(PhysReg::RIP, 0, 0);
+                table.sym = std::format(".Ljt_{}_{}", func.fname, tables.size());
+                MOperand entry = MOperand::m(PhysReg::R11, 0, 4);
+                entry.vindex = instr.s1;
+                entry.scale = 4;
+                emit("cmp", {idx, I(instr.labels.size())});
+                emit("jae", {MOperand::label(blockLabel(instr.imm))});
+                emit("lea", {R(PhysReg::R11), table});
+                emit("movsxd", {R(PhysReg::RAX), entry});
+                emit("add", {R(PhysReg::RAX), R(PhysReg::R11)});
+                emit("jmp", {R(PhysReg::RAX)});
+                tables.push_back(&instr.labels);
                 break;
             }
             case IRCmd::JZ:
+            case IRCmd::JNZ:
             {
-                PhysReg rCond = func.regAlloc.alloc(instr.s1);
-                out.print("  cmp {}, 0\n", regName(rCond));
-                out.print("  je .L{}{}\n", func.fname, instr.imm);
+                emit("cmp", {opnd(instr.s1), I(0)});
+                emit(instr.cmd == IRCmd::JZ ? "je" : "jne", {MOperand::label(blockLabel(instr.imm))});
                 break;
             }
             case IRCmd::CALL:
+            case IRCmd::TAILCALL:
             {
-
+                static const PhysReg argRegs[] = {PhysReg::RDI, PhysReg::RSI, PhysReg::RDX, PhysReg::RCX, PhysReg::R8, PhysReg::R9};
                 for (size_t i = 0; i < instr.args.size(); i++) {
-                    PhysReg rArg = func.regAlloc.alloc(instr.args[i]);
-                    static const char* argRegs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
                     if (i < 6) {
-                        out.print("  mov {}, {}\n", argRegs[i], regName(rArg));
+                        emit("mov", {R(argRegs[i]), opnd(instr.args[i])});
                     } else {
                         // For simplicity, we won't handle more than 6 arguments here.
                         fprintf(stderr, "Error: More than 6 function arguments not supported in X86 generation.\n");
@@ -343,28 +378,48 @@ void X86Generator::emitFunc(IRFunc& func){
                     }
                 }
 
-                PhysReg r = func.regAlloc.alloc(instr.t);
-                out.print("  call {}\n", irm.getSymbol(instr.imm).name);
-                out.print("  mov {}, rax\n", regName(r));
+                MOperand callee = MOperand::label(irm.getSymbol(instr.imm).name);
+                if(instr.cmd == IRCmd::TAILCALL){
+                    // the callee returns straight to our caller
+                    emit("epilogue");
+                    emit("jmp", {callee});
+                    break;
+                }
+                emit("call", {callee});
+                emit("mov", {V(instr.t), R(PhysReg::RAX)});
                 break;
             }
             case IRCmd::MOV:
             {
-                PhysReg rSrc = func.regAlloc.alloc(instr.s1);
-                PhysReg rDst = func.regAlloc.alloc(instr.t);
-                out.print("  mov {}, {}\n", regName(rDst), regName(rSrc));
+                emit("mov", {V(instr.t), opnd(instr.s1)});
                 break;
             }
             case IRCmd::MOV_IMM:
             {
-                PhysReg r = func.regAlloc.alloc(instr.t);
-                out.print("  mov {}, {}\n", regName(r), instr.imm);
+                emit("mov", {V(instr.t), I(instr.imm)});
                 break;
             }
             case IRCmd::LEA_STRING:
             {
-                PhysReg r = func.regAlloc.alloc(instr.t);
-                out.print("  lea {}, [rip + .LC{}]\n", regName(r), instr.imm);
+                MOperand str = MOperand::m(PhysReg::RIP, 0, 0);
+                str.sym = std::format(".LC{}", instr.imm);
+                emit("lea", {V(instr.t), str});
+                break;
+            }
+            case IRCmd::PARAM:
+            {
+                static const PhysReg paramRegs[] = {PhysReg::RDI, PhysReg::RSI, PhysReg::RDX, PhysReg::RCX, PhysReg::R8, PhysReg::R9};
+                emit("mov", {V(instr.t), R(paramRegs[instr.imm])});
+                break;
+            }
+            case IRCmd::RELOAD:
+            {
+                emit("mov", {V(instr.t), MOperand::m(PhysReg::RBP, -(int64_t)instr.imm)});
+                break;
+            }
+            case IRCmd::SPILL:
+            {
+                emit("mov", {MOperand::m(PhysReg::RBP, -(int64_t)instr.imm), V(instr.s1)});
                 break;
             }
             default:
@@ -373,13 +428,22 @@ void X86Generator::emitFunc(IRFunc& func){
         }
     }
 
-    out.print("  pop r15\n");
-    out.print("  pop r14\n");
-    out.print("  pop r13\n");
-    out.print("  pop r12\n");
+    code.push_back(MInstr::label(retLabel));
+    emit("epilogue");
+    emit("ret");
 
-    out.print("ret_{}:\n", func.fname);
-    out.print("  mov rsp, rbp\n");
-    out.print("  pop rbp\n");
-    out.print("  ret\n");
+    // jump tables hold 32-bit offsets from the table start
+    if(!tables.empty()){
+        code.push_back(MInstr::directive(".section", {MOperand::label(".rodata")}));
+        for(size_t k = 0; k < tables.size(); k++){
+            std::string name = std::format(".Ljt_{}_{}", func.fname, k);
+            code.push_back(MInstr::directive(".align", {I(4)}));
+            code.push_back(MInstr::label(name));
+            for(auto label : *tables[k]){
+                code.push_back(MInstr::directive(".long", {MOperand::label(blockLabel(label)), MOperand::label(name)}));
+            }
+        }
+        code.push_back(MInstr::directive(".text"));
+    }
+    return mf;
 }
@@ -1,16 +1,20 @@
 #pragma once
 #include "gen_ir.h"
 #include "context.h"
+#include "mir.h"
+#include "encode_x86-64.h"
 
 class X86Generator{
     IRModule& irm;
     Output out;
-    void emitFunc(IRFunc& func);
+    MFunction compileFunc(IRFunc& func);
+    MFunction lower(IRFunc& func);
     void emitStringLiterals();
 public:
     X86Generator(IRModule& irm_) : irm(irm_), out() {}
     void setOutputFile(const std::string filename) {
         out.setFileContext(filename);
     }
-    void emit();
+    void emit();                        // assembly text
+    void emitObject(ObjectCode& obj);   // machine code
 };
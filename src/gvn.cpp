@@ -0,0 +1,194 @@
+#include "opt.h"
+
+#include <unordered_map>
+
+namespace {
+
+struct ExprKey{
+    IRCmd cmd;
+    VRegID a;
+    VRegID b;
+    int32_t imm;
+    bool operator==(const ExprKey&) const = default;
+};
+
+struct ExprHash{
+    size_t operator()(const ExprKey& k) const{
+        uint64_t h = (uint64_t)k.cmd;
+        h = h * 0x9e3779b97f4a7c15ull + (uint32_t)k.a;
+        h = h * 0x9e3779b97f4a7c15ull + (uint32_t)k.b;
+        h = h * 0x9e3779b97f4a7c15ull + (uint32_t)k.imm;
+        return h ^ (h >> 29);
+    }
+};
+
+// Instructions whose result depends only on their operands. A division is
+// only reused where an identical one dominates it, which would have trapped
+// first.
+bool isPure(IRCmd cmd){
+    switch(cmd){
+        case IRCmd::ADD:
+        case IRCmd::SUB:
+        case IRCmd::MUL:
+        case IRCmd::DIV:
+        case IRCmd::MOD:
+        case IRCmd::BIT_XOR:
+        case IRCmd::BIT_OR:
+        case IRCmd::BIT_AND:
+        case IRCmd::EQUAL:
+        case IRCmd::NEQUAL:
+        case IRCmd::LT:
+        case IRCmd::LE:
+        case IRCmd::LSHIFT:
+        case IRCmd::RSHIFT:
+        case IRCmd::MOV_IMM:
+        case IRCmd::FRAME_ADDR:
+        case IRCmd::LEA_STRING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isCommutative(IRCmd cmd){
+    switch(cmd){
+        case IRCmd::ADD:
+        case IRCmd::MUL:
+        case IRCmd::BIT_XOR:
+        case IRCmd::BIT_OR:
+        case IRCmd::BIT_AND:
+        case IRCmd::EQUAL:
+        case IRCmd::NEQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+void GVN::run(){
+    CFG& cfg = f.cfg;
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+    if(cfg.blocks.empty()) return;
+    cfg.computeDominators();
+
+    // only values with a single definition can be numbered
+    std::vector<int32_t> defs(nV, 0);
+    for(auto& ins : pool){
+        if(ins.t >= 0) defs[ins.t]++;
+    }
+    std::vector<VRegID> repl(nV);
+    for(size_t v = 0; v < nV; v++){
+        repl[v] = v;
+    }
+    auto find = [&](VRegID v){
+        while(repl[v] != v){
+            repl[v] = repl[repl[v]];
+            v = repl[v];
+        }
+        return v;
+    };
+    auto rewrite = [&](IRInstr& ins){
+        if(ins.s1 >= 0) ins.s1 = find(ins.s1);
+        if(ins.s2 >= 0) ins.s2 = find(ins.s2);
+        for(auto& a : ins.args) a = find(a);
+    };
+
+    std::vector<bool> dead(pool.size(), false);
+    std::unordered_map<ExprKey, VRegID, ExprHash> table;
+    std::vector<ExprKey> undo;          // keys added, popped when leaving a dominator subtree
+    uint64_t removed = 0;
+
+    auto visitBlock = [&](BlockIdx b){
+        for(size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++){
+            IRInstr& ins = pool[i];
+            if(ins.t < 0 || defs[ins.t] != 1){
+                if(ins.cmd != IRCmd::PHI) rewrite(ins);
+                continue;
+            }
+            if(ins.cmd == IRCmd::PHI){
+                // every input already known to be the same value; inputs
+                // along back edges are not numbered yet and never match
+                VRegID same = -1;
+                bool unique = true;
+                for(auto a : ins.args){
+                    VRegID v = find(a);
+                    if(v == ins.t) continue;
+                    if(same >= 0 && v != same) unique = false;
+                    same = v;
+                }
+                if(unique && same >= 0 && defs[same] == 1){
+                    repl[ins.t] = same;
+                    dead[i] = true;
+                    removed++;
+                }
+                continue;
+            }
+            rewrite(ins);
+            if(ins.cmd == IRCmd::MOV){
+                if(defs[ins.s1] != 1) continue;
+                repl[ins.t] = ins.s1;
+                dead[i] = true;
+                removed++;
+                continue;
+            }
+            if(!isPure(ins.cmd)) continue;
+            if((ins.s1 >= 0 && defs[ins.s1] != 1) || (ins.s2 >= 0 && defs[ins.s2] != 1)) continue;
+
+            ExprKey key{ins.cmd, ins.s1, ins.s2, 0};
+            if(ins.cmd == IRCmd::MOV_IMM || ins.cmd == IRCmd::FRAME_ADDR || ins.cmd == IRCmd::LEA_STRING){
+                key.imm = ins.imm;
+            }
+            if(isCommutative(ins.cmd) && key.b < key.a) std::swap(key.a, key.b);
+            auto [it, inserted] = table.emplace(key, ins.t);
+            if(inserted){
+                undo.push_back(key);
+                continue;
+            }
+            repl[ins.t] = it->second;
+            dead[i] = true;
+            removed++;
+        }
+    };
+
+    // preorder walk of the dominator tree: a value is visible in the
+    // blocks its definition dominates
+    struct Frame{
+        BlockIdx b;
+        size_t child;
+        size_t mark;
+    };
+    std::vector<Frame> stack;
+    stack.push_back({cfg.entry, 0, 0});
+    visitBlock(cfg.entry);
+    while(!stack.empty()){
+        Frame& top = stack.back();
+        auto& kids = cfg.blocks[top.b].domChildren;
+        if(top.child < kids.size()){
+            BlockIdx c = kids[top.child++];
+            stack.push_back({c, 0, undo.size()});
+            visitBlock(c);
+            continue;
+        }
+        while(undo.size() > top.mark){
+            table.erase(undo.back());
+            undo.pop_back();
+        }
+        stack.pop_back();
+    }
+    stats.add("gvn.removed", removed);
+    if(removed == 0) return;
+
+    // PHI inputs along back edges are only final now
+    size_t w = 0;
+    for(size_t i = 0; i < pool.size(); i++){
+        if(dead[i]) continue;
+        rewrite(pool[i]);
+        if(w != i) pool[w] = std::move(pool[i]);
+        w++;
+    }
+    pool.resize(w);
+    cfg.build(f);
+}
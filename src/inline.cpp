@@ -0,0 +1,213 @@
+#include "opt.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+// a caller stops taking inlined bodies beyond this size
+constexpr uint32_t INLINE_CALLER_MAX = 2000;
+// the call sequence and the callee's frame set-up disappear with the call
+constexpr uint32_t CALL_BENEFIT = 2;
+// a constant argument usually folds part of the callee away
+constexpr uint32_t CONST_ARG_BENEFIT = 2;
+
+constexpr size_t NO_FUNC = SIZE_MAX;
+
+bool isCall(IRCmd cmd){
+    return cmd == IRCmd::CALL || cmd == IRCmd::TAILCALL;
+}
+
+} // namespace
+
+// Body for the function a CALL invokes, or nullptr when it is unknown.
+// funcIdx is its index in m.funcPool, NO_FUNC for an imported body.
+const IRFunc* Inliner::calleeOf(const IRInstr& call, size_t& funcIdx){
+    funcIdx = NO_FUNC;
+    const Symbol& sym = m.getSymbol(call.imm);
+    if(sym.params.size() != call.args.size()){
+        return nullptr;
+    }
+    if(!sym.inlineIR.empty()){
+        auto it = importedOf.find(call.imm);
+        if(it == importedOf.end()){
+            IRFunc body;
+            int32_t slot = -1;
+            if(body.decode(sym.inlineIR)){
+                body.fname = sym.name;
+                slot = imported.size();
+                imported.push_back(std::move(body));
+            }
+            it = importedOf.emplace(call.imm, slot).first;
+        }
+        return (it->second < 0) ? nullptr : &imported[it->second];
+    }
+    for(size_t i = 0; i < m.funcPool.size(); i++){
+        if(m.funcPool[i].fname == sym.name){
+            funcIdx = i;
+            return &m.funcPool[i];
+        }
+    }
+    return nullptr;
+}
+
+void Inliner::inlineCall(IRFunc& caller, const IRInstr& call, const IRFunc& callee, std::vector<IRInstr>& out){
+    VRegID vbase = caller.vregs.size();
+    caller.vregs.resize(vbase + callee.vregs.size());
+    int32_t lbase = caller.labelCounter;
+    caller.labelCounter += callee.labelCounter;
+    uint32_t fbase = caller.localStackSize;
+    caller.localStackSize += callee.localStackSize;
+    int32_t endLabel = caller.newLabel();
+
+    auto vreg = [&](VRegID v){ return (v < 0) ? v : v + vbase; };
+    for(size_t i = 0; i < callee.instrPool.size(); i++){
+        IRInstr ins = callee.instrPool[i];
+        ins.s1 = vreg(ins.s1);
+        ins.s2 = vreg(ins.s2);
+        ins.t = vreg(ins.t);
+        for(auto& a : ins.args) a = vreg(a);
+        for(auto& l : ins.labels) l += lbase;
+        if(hasLabelImm(ins.cmd)) ins.imm += lbase;
+
+        switch(ins.cmd){
+            case IRCmd::FRAME_ADDR:
+                ins.imm += fbase;
+                break;
+            case IRCmd::PARAM:
+                ins.cmd = IRCmd::MOV;
+                ins.s1 = call.args[ins.imm];
+                break;
+            case IRCmd::RET:
+            {
+                if(call.cmd == IRCmd::TAILCALL) break;     // returns from the caller as well
+                out.push_back(ins);
+                out.back().cmd = IRCmd::MOV;
+                out.back().t = call.t;
+                if(i + 1 < callee.instrPool.size()){
+                    ins = IRInstr();
+                    ins.cmd = IRCmd::JMP;
+                    ins.imm = endLabel;
+                    out.push_back(ins);
+                }
+                continue;
+            }
+            case IRCmd::TAILCALL:
+            {
+                if(call.cmd == IRCmd::TAILCALL) break;     // still the caller's tail call
+                // at an ordinary call site the sibling's result is this call's
+                ins.cmd = IRCmd::CALL;
+                ins.t = caller.newVReg();
+                out.push_back(ins);
+                ins = IRInstr();
+                ins.cmd = IRCmd::MOV;
+                ins.t = call.t;
+                ins.s1 = out.back().t;
+                out.push_back(ins);
+                if(i + 1 < callee.instrPool.size()){
+                    ins = IRInstr();
+                    ins.cmd = IRCmd::JMP;
+                    ins.imm = endLabel;
+                    out.push_back(ins);
+                }
+                continue;
+            }
+            default:
+                break;
+        }
+        out.push_back(ins);
+    }
+
+    if(call.cmd == IRCmd::TAILCALL) return;
+    IRInstr end;
+    end.cmd = IRCmd::LLABEL;
+    end.imm = endLabel;
+    out.push_back(end);
+}
+
+void Inliner::run(){
+    size_t n = m.funcPool.size();
+
+    // call graph over the functions of this module
+    std::vector<std::vector<size_t>> calls(n);
+    for(size_t i = 0; i < n; i++){
+        for(auto& ins : m.funcPool[i].instrPool){
+            size_t callee;
+            if(isCall(ins.cmd) && calleeOf(ins, callee) && callee != NO_FUNC){
+                calls[i].push_back(callee);
+            }
+        }
+    }
+
+    // Tarjan's algorithm completes each component after everything it calls
+    std::vector<int32_t> index(n, -1), low(n, 0), comp(n, -1);
+    std::vector<size_t> stack;
+    std::vector<std::vector<size_t>> order;
+    int32_t counter = 0;
+    auto visit = [&](auto& self, size_t v) -> void {
+        index[v] = low[v] = counter++;
+        stack.push_back(v);
+        for(auto w : calls[v]){
+            if(index[w] < 0){
+                self(self, w);
+                low[v] = std::min(low[v], low[w]);
+            } else if(comp[w] < 0){
+                low[v] = std::min(low[v], index[w]);
+            }
+        }
+        if(low[v] != index[v]) return;
+        order.emplace_back();
+        size_t w;
+        do {
+            w = stack.back();
+            stack.pop_back();
+            comp[w] = order.size() - 1;
+            order.back().push_back(w);
+        } while(w != v);
+    };
+    for(size_t i = 0; i < n; i++){
+        if(index[i] < 0) visit(visit, i);
+    }
+
+    uint64_t inlined = 0;
+    for(auto& component : order){
+        for(auto fi : component){
+            IRFunc& f = m.funcPool[fi];
+            uint32_t size = f.inlineCost();
+            std::vector<IRInstr> pool;
+            pool.swap(f.instrPool);
+            std::vector<IRInstr> out;
+            out.reserve(pool.size());
+            bool changed = false;
+            std::vector<bool> isConst(f.vregs.size(), false);
+            for(auto& ins : pool){
+                if(ins.cmd == IRCmd::MOV_IMM) isConst[ins.t] = true;
+            }
+            for(auto& ins : pool){
+                size_t ci;
+                const IRFunc* callee = isCall(ins.cmd) ? calleeOf(ins, ci) : nullptr;
+                if(callee == nullptr || (ci != NO_FUNC && comp[ci] == comp[fi])){
+                    out.push_back(std::move(ins));
+                    continue;
+                }
+
+                uint32_t cost = callee->inlineCost();
+                uint32_t benefit = CALL_BENEFIT;
+                for(auto a : ins.args){
+                    if(isConst[a]) benefit += CONST_ARG_BENEFIT;
+                }
+                if(cost > threshold + benefit || size + cost > INLINE_CALLER_MAX){
+                    out.push_back(std::move(ins));
+                    continue;
+                }
+                inlineCall(f, ins, *callee, out);
+                size += cost;
+                inlined++;
+                changed = true;
+            }
+            f.instrPool.swap(out);
+            if(changed) f.cfg.build(f);
+        }
+    }
+    stats.add("inline.calls", inlined);
+}
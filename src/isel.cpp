@@ -0,0 +1,198 @@
+#include "isel.h"
+
+namespace {
+
+constexpr uint8_t R = OpReg;
+constexpr uint8_t RI = OpReg | OpImm;
+constexpr uint8_t RM = OpReg | OpMem;
+constexpr uint8_t RIM = OpReg | OpImm | OpMem;
+constexpr uint8_t RA = OpReg | OpAddr;
+
+const Pattern patterns[] = {
+    // cmd                 form            op       swapped  s1   s2   args  single
+    {IRCmd::ADD,           Form::BinOp,    "add",   "",      RIM, RIM, R,    false},
+    {IRCmd::SUB,           Form::BinOp,    "sub",   "",      RIM, RIM, R,    false},
+    {IRCmd::MUL,           Form::Special,  "",      "",      RIM, RIM, R,    false},
+    {IRCmd::BIT_AND,       Form::BinOp,    "and",   "",      RIM, RIM, R,    false},
+    {IRCmd::BIT_OR,        Form::BinOp,    "or",    "",      RIM, RIM, R,    false},
+    {IRCmd::BIT_XOR,       Form::BinOp,    "xor",   "",      RIM, RIM, R,    false},
+    {IRCmd::LSHIFT,        Form::Shift,    "shl",   "",      RIM, RI,  R,    false},
+    {IRCmd::RSHIFT,        Form::Shift,    "shr",   "",      RIM, RI,  R,    false},
+    {IRCmd::EQUAL,         Form::Compare,  "e",     "e",     RIM, RIM, R,    true},
+    {IRCmd::NEQUAL,        Form::Compare,  "ne",    "ne",    RIM, RIM, R,    true},
+    {IRCmd::LT,            Form::Compare,  "l",     "g",     RIM, RIM, R,    true},
+    {IRCmd::LE,            Form::Compare,  "le",    "ge",    RIM, RIM, R,    true},
+    {IRCmd::JEQ,           Form::Branch,   "e",     "e",     RIM, RIM, R,    true},
+    {IRCmd::JNE,           Form::Branch,   "ne",    "ne",    RIM, RIM, R,    true},
+    {IRCmd::JLT,           Form::Branch,   "l",     "g",     RIM, RIM, R,    true},
+    {IRCmd::JLE,           Form::Branch,   "le",    "ge",    RIM, RIM, R,    true},
+    {IRCmd::JGT,           Form::Branch,   "g",     "l",     RIM, RIM, R,    true},
+    {IRCmd::JGE,           Form::Branch,   "ge",    "le",    RIM, RIM, R,    true},
+    {IRCmd::DIV,           Form::Special,  "",      "",      RIM, RIM, R,    true},
+    {IRCmd::MOD,           Form::Special,  "",      "",      RIM, RIM, R,    true},
+    {IRCmd::MOV,           Form::Special,  "",      "",      RIM, R,   R,    false},
+    {IRCmd::RET,           Form::Special,  "",      "",      RIM, R,   R,    false},
+    {IRCmd::JZ,            Form::Special,  "",      "",      RM,  R,   R,    false},
+    {IRCmd::JNZ,           Form::Special,  "",      "",      RM,  R,   R,    false},
+    {IRCmd::LOAD,          Form::Special,  "",      "",      RA,  R,   R,    false},
+    {IRCmd::SAVE,          Form::Special,  "",      "",      RA,  RI,  R,    false},
+    {IRCmd::CALL,          Form::Special,  "",      "",      R,   R,   RIM,  false},
+    {IRCmd::TAILCALL,      Form::Special,  "",      "",      R,   R,   RIM,  false},
+};
+
+const Pattern regOnly = {IRCmd::ADD, Form::Special, "", "", R, R, R, false};
+
+// Conditional jump taken when `cmp` holds (JNZ) or fails (JZ).
+IRCmd fusedBranch(IRCmd cmp, bool whenTrue){
+    switch(cmp){
+        case IRCmd::EQUAL: return whenTrue ? IRCmd::JEQ : IRCmd::JNE;
+        case IRCmd::NEQUAL: return whenTrue ? IRCmd::JNE : IRCmd::JEQ;
+        case IRCmd::LT: return whenTrue ? IRCmd::JLT : IRCmd::JGE;
+        case IRCmd::LE: return whenTrue ? IRCmd::JLE : IRCmd::JGT;
+        default: return cmp;
+    }
+}
+
+} // namespace
+
+const Pattern& patternOf(IRCmd cmd){
+    static const auto table = []{
+        std::vector<const Pattern*> t;
+        for(auto& p : patterns){
+            if((size_t)p.cmd >= t.size()) t.resize((size_t)p.cmd + 1, nullptr);
+            t[(size_t)p.cmd] = &p;
+        }
+        return t;
+    }();
+    if((size_t)cmd < table.size() && table[(size_t)cmd]){
+        return *table[(size_t)cmd];
+    }
+    return regOnly;
+}
+
+void ISel::fuseBranches(){
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+    std::vector<int32_t> uses(nV, 0);
+    std::vector<int64_t> defAt(nV, -1);
+    for(size_t i = 0; i < pool.size(); i++){
+        IRInstr& ins = pool[i];
+        if(ins.s1 >= 0) uses[ins.s1]++;
+        if(ins.s2 >= 0) uses[ins.s2]++;
+        for(auto a : ins.args) uses[a]++;
+        if(ins.t >= 0) defAt[ins.t] = (defAt[ins.t] == -1) ? (int64_t)i : -2;
+    }
+
+    std::vector<bool> dead(pool.size(), false);
+    bool any = false;
+    for(size_t j = 0; j < pool.size(); j++){
+        IRInstr& br = pool[j];
+        if(br.cmd != IRCmd::JZ && br.cmd != IRCmd::JNZ) continue;
+        VRegID v = br.s1;
+        if(uses[v] != 1 || defAt[v] < 0) continue;
+        size_t d = defAt[v];
+        IRInstr& cmp = pool[d];
+        IRCmd fused = fusedBranch(cmp.cmd, br.cmd == IRCmd::JNZ);
+        if(fused == cmp.cmd || d > j) continue;
+
+        // the operands must still hold the same values at the branch
+        bool ok = true;
+        for(size_t k = d + 1; k < j && ok; k++){
+            const IRInstr& mid = pool[k];
+            if(mid.cmd == IRCmd::LLABEL || isTerminator(mid.cmd)) ok = false;
+            if(mid.t >= 0 && (mid.t == cmp.s1 || mid.t == cmp.s2)) ok = false;
+        }
+        if(!ok) continue;
+
+        br.cmd = fused;
+        br.s1 = cmp.s1;
+        br.s2 = cmp.s2;
+        dead[d] = true;
+        any = true;
+    }
+    if(!any) return;
+
+    size_t w = 0;
+    for(size_t i = 0; i < pool.size(); i++){
+        if(dead[i]) continue;
+        if(w != i) pool[w] = std::move(pool[i]);
+        w++;
+    }
+    pool.resize(w);
+}
+
+void ISel::run(){
+    fuseBranches();
+
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+
+    // candidates: single definitions by MOV_IMM / FRAME_ADDR
+    std::vector<int32_t> defCount(nV, 0);
+    std::vector<uint8_t> kindOf(nV, 0);         // OpImm / OpAddr for candidates
+    std::vector<int32_t> valOf(nV, 0);
+    for(auto& ins : pool){
+        if(ins.t < 0) continue;
+        defCount[ins.t]++;
+        if(ins.cmd == IRCmd::MOV_IMM) kindOf[ins.t] = OpImm;
+        else if(ins.cmd == IRCmd::FRAME_ADDR) kindOf[ins.t] = OpAddr;
+        valOf[ins.t] = ins.imm;
+    }
+    for(size_t v = 0; v < nV; v++){
+        if(defCount[v] != 1) kindOf[v] = 0;
+    }
+
+    std::vector<IRInstr> out;
+    out.reserve(pool.size());
+    for(auto& ins : pool){
+        if(ins.t >= 0 && kindOf[ins.t]){
+            continue;       // folded into its users
+        }
+        const Pattern& p = patternOf(ins.cmd);
+
+        // uses that cannot take the operand directly get their own copy
+        auto materialize = [&](VRegID& v){
+            IRInstr def;
+            def.cmd = (kindOf[v] == OpImm) ? IRCmd::MOV_IMM : IRCmd::FRAME_ADDR;
+            def.t = f.newVReg();
+            def.imm = valOf[v];
+            out.push_back(def);
+            v = def.t;
+        };
+        auto select = [&](VRegID& v, uint8_t accepted){
+            if(v < 0 || !kindOf[v]) return false;
+            if(accepted & kindOf[v]) return true;
+            materialize(v);
+            return false;
+        };
+        // idiv keeps the trap on a zero divisor and the overflow on -1
+        uint8_t s2Kinds = p.s2;
+        if((ins.cmd == IRCmd::DIV || ins.cmd == IRCmd::MOD) && ins.s2 >= 0 && kindOf[ins.s2] == OpImm
+           && (valOf[ins.s2] == 0 || valOf[ins.s2] == -1)){
+            s2Kinds &= ~OpImm;
+        }
+        bool folded2 = select(ins.s2, s2Kinds);
+        if(p.single && folded2 && ins.s1 >= 0 && kindOf[ins.s1]){
+            materialize(ins.s1);
+        } else {
+            select(ins.s1, p.s1);
+        }
+        for(auto& a : ins.args){
+            select(a, p.args);
+        }
+        out.push_back(ins);
+    }
+    pool.swap(out);
+
+    kindOf.resize(f.vregs.size(), 0);
+    for(size_t v = 0; v < nV; v++){
+        if(kindOf[v] == OpImm){
+            f.vregs[v].kind = VRegKind::Imm;
+            f.vregs[v].val = valOf[v];
+        } else if(kindOf[v] == OpAddr){
+            f.vregs[v].kind = VRegKind::LVarAddr;
+            f.vregs[v].val = valOf[v];
+        }
+    }
+    f.cfg.build(f);
+}
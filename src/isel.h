@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+
+#include "gen_ir.h"
+
+/// Operand kinds an instruction position can take directly.
+enum OperandKind : uint8_t {
+    OpReg  = 1 << 0,        // physical register
+    OpImm  = 1 << 1,        // 32-bit immediate (VRegKind::Imm)
+    OpMem  = 1 << 2,        // value in a frame slot (VRegKind::Slot)
+    OpAddr = 1 << 3,        // frame slot used as an address (VRegKind::LVarAddr)
+};
+
+/// How X86Generator expands an instruction.
+enum class Form : uint8_t {
+    Special,        // hand-written case in X86Generator::emitFunc
+    BinOp,          // mov t, s1 / op t, s2
+    Shift,          // mov t, s1 / op t, imm  or  mov cl, s2 / op t, cl
+    Compare,        // cmp s1, s2 / setcc t / movzx t
+    Branch,         // cmp s1, s2 / jcc label
+};
+
+class Pattern{
+public:
+    IRCmd cmd;
+    Form form;
+    const char* op;         // mnemonic, or condition code for Compare/Branch
+    const char* swappedOp;  // Compare/Branch: condition code with s1 and s2 exchanged
+    uint8_t s1;             // OperandKind mask accepted for s1
+    uint8_t s2;             // OperandKind mask accepted for s2
+    uint8_t args;           // OperandKind mask accepted for args
+    bool single;            // at most one of s1/s2 may be a non-register
+};
+
+/// Pattern for cmd; commands without a table entry take registers only.
+const Pattern& patternOf(IRCmd cmd);
+
+/// Operand selection.
+/// A compare whose only use is the JZ/JNZ behind it in the same block is
+/// fused into one compare-and-branch (JEQ ... JGE). Constants defined once
+/// by MOV_IMM and frame addresses used only by LOAD/SAVE stop being register
+/// values: they become VRegKind::Imm / LVarAddr and are folded into the
+/// instructions using them. Uses that cannot take them directly get a fresh
+/// MOV_IMM / FRAME_ADDR in front.
+class ISel{
+    IRFunc& f;
+    void fuseBranches();
+public:
+    ISel(IRFunc& func) : f(func) {}
+    void run();
+};
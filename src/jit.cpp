@@ -0,0 +1,74 @@
+#include "jit.h"
+#include "link.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+// print and exit as std.o implements them: an unbuffered write to
+// stdout, so output survives a program killed by a signal
+void jitPrint(const char* s){
+    size_t len = strlen(s);
+    while(len > 0){
+        ssize_t n = write(1, s, len);
+        if(n <= 0) return;
+        s += n;
+        len -= n;
+    }
+}
+
+void jitExit(int64_t status){
+    exit((int)status);
+}
+
+size_t pageAlign(size_t size){
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+} // namespace
+
+int64_t JIT::run(){
+    Linker linker;
+    linker.add(obj);
+    linker.addExterns({
+        {"print", reinterpret_cast<const void*>(&jitPrint)},
+        {"exit", reinterpret_cast<const void*>(&jitExit)},
+    });
+    const ObjectCode& image = linker.getImage();
+
+    // text and rodata on their own pages: writable while the image is
+    // copied in, then read/execute and read-only
+    size_t textSize = pageAlign(image.text.size());
+    size_t rodataSize = pageAlign(image.rodata.size());
+    void* mem = mmap(nullptr, textSize + rodataSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED){
+        fprintf(stderr, "JIT error: cannot map %zu bytes\n", textSize + rodataSize);
+        exit(1);
+    }
+    uint8_t* text = static_cast<uint8_t*>(mem);
+    uint8_t* rodata = text + textSize;
+    linker.relocate(reinterpret_cast<uint64_t>(text), reinterpret_cast<uint64_t>(rodata));
+    memcpy(text, image.text.data(), image.text.size());
+    memcpy(rodata, image.rodata.data(), image.rodata.size());
+    if(mprotect(text, textSize, PROT_READ | PROT_EXEC) != 0
+       || (rodataSize && mprotect(rodata, rodataSize, PROT_READ) != 0)){
+        fprintf(stderr, "JIT error: cannot protect the image\n");
+        exit(1);
+    }
+
+    uint64_t entry = linker.address("main");
+    if(entry == 0){
+        fprintf(stderr, "JIT error: no main\n");
+        exit(1);
+    }
+    auto mainFn = reinterpret_cast<int64_t (*)()>(entry);
+    int64_t result = mainFn();
+    munmap(mem, textSize + rodataSize);
+    return result;
+}
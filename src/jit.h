@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+#include "encode_x86-64.h"
+
+/// Runs an encoded module inside the compiler process. The image is
+/// linked at the address of an mmap'ed buffer, with print and exit bound
+/// to host implementations in place of std.o, then its text is made
+/// executable and main is called directly.
+class JIT{
+    const ObjectCode& obj;
+public:
+    JIT(const ObjectCode& obj) : obj(obj) {};
+
+    int64_t run();      // main's return value
+};
@@ -0,0 +1,213 @@
+#include "opt.h"
+
+#include <algorithm>
+
+namespace {
+
+// Instructions whose result depends only on their operands and that cannot
+// trap. DIV and MOD are only moved for a divisor known not to fault.
+bool isHoistable(IRCmd cmd){
+    switch(cmd){
+        case IRCmd::ADD:
+        case IRCmd::SUB:
+        case IRCmd::MUL:
+        case IRCmd::BIT_XOR:
+        case IRCmd::BIT_OR:
+        case IRCmd::BIT_AND:
+        case IRCmd::EQUAL:
+        case IRCmd::NEQUAL:
+        case IRCmd::LT:
+        case IRCmd::LE:
+        case IRCmd::LSHIFT:
+        case IRCmd::RSHIFT:
+        case IRCmd::MOV_IMM:
+        case IRCmd::FRAME_ADDR:
+        case IRCmd::LEA_STRING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+void LICM::run(){
+    CFG& cfg = f.cfg;
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+    size_t nB = cfg.blocks.size();
+    if(nB == 0) return;
+    cfg.computeDominators();
+
+    std::vector<Loop> loops = cfg.findLoops();
+    if(loops.empty()){
+        stats.add("licm.hoisted", 0);
+        return;
+    }
+
+    // instructions regrouped per block; preheaders are appended as new blocks
+    std::vector<std::vector<IRInstr>> code(nB);
+    for(size_t b = 0; b < nB; b++){
+        code[b].assign(pool.begin() + cfg.blocks[b].begin, pool.begin() + cfg.blocks[b].end);
+    }
+    // a preheader falling through into its header is laid out just ahead of it
+    std::vector<BlockIdx> placeBefore(nB, -1);
+    std::vector<BlockIdx> appended;
+    std::vector<int32_t> defs(nV, 0);
+    std::vector<BlockIdx> defBlock(nV, -1);
+    std::vector<int64_t> constOf(nV, 0);
+    std::vector<bool> isConst(nV, false);
+    for(size_t b = 0; b < nB; b++){
+        for(auto& ins : code[b]){
+            if(ins.t < 0) continue;
+            defs[ins.t]++;
+            defBlock[ins.t] = b;
+            if(ins.cmd == IRCmd::MOV_IMM){
+                isConst[ins.t] = true;
+                constOf[ins.t] = ins.imm;
+            }
+        }
+    }
+    // a preheader made for an inner loop belongs to the outer loops
+    // containing the block it was split from
+    std::vector<BlockIdx> origin(nB);
+    for(size_t b = 0; b < nB; b++){
+        origin[b] = b;
+    }
+    std::vector<std::vector<BlockIdx>> preheadersOf(nB);    // by origin
+    std::vector<BlockIdx> headerOf(nB, -1);                 // of a preheader
+
+    // loopOf[b] is the index of the loop whose body was last marked
+    std::vector<int32_t> loopOf(nB, -1);
+    uint64_t hoisted = 0;
+    for(size_t li = 0; li < loops.size(); li++){
+        const Loop& l = loops[li];
+        for(auto b : l.blocks){
+            loopOf[b] = li;
+        }
+        auto inLoop = [&](BlockIdx b){ return loopOf[origin[b]] == (int32_t)li; };
+        BlockIdx h = l.header;
+        BlockIdx pred = -1;
+        int32_t outside = 0;
+        for(auto p : cfg.blocks[h].preds){
+            if(inLoop(p) || !cfg.reachable(p)) continue;
+            pred = p;
+            outside++;
+        }
+        if(outside != 1) continue;
+
+        auto invariant = [&](const IRInstr& ins){
+            if(ins.t < 0 || defs[ins.t] != 1 || !ins.args.empty()) return false;
+            for(VRegID v : {ins.s1, ins.s2}){
+                if(v >= 0 && (defs[v] != 1 || inLoop(defBlock[v]))) return false;
+            }
+            if(ins.cmd == IRCmd::DIV || ins.cmd == IRCmd::MOD){
+                // a zero check inside the loop may be what keeps it from trapping
+                return isConst[ins.s2] && constOf[ins.s2] != 0 && constOf[ins.s2] != -1;
+            }
+            return isHoistable(ins.cmd);
+        };
+
+        // reverse postorder with each preheader just ahead of its header, so
+        // definitions are seen before their uses
+        std::vector<std::pair<int32_t, BlockIdx>> order;
+        for(auto b : l.blocks){
+            order.emplace_back(2 * cfg.rpoIndex[b] + 1, b);
+            for(auto p : preheadersOf[b]){
+                order.emplace_back(2 * cfg.rpoIndex[headerOf[p]], p);
+            }
+        }
+        std::sort(order.begin(), order.end());
+
+        std::vector<IRInstr> moved;
+        for(auto& o : order){
+            auto& list = code[o.second];
+            size_t w = 0;
+            for(size_t i = 0; i < list.size(); i++){
+                if(invariant(list[i])){
+                    defBlock[list[i].t] = pred;     // outside this loop from now on
+                    moved.push_back(std::move(list[i]));
+                    continue;
+                }
+                if(w != i) list[w] = std::move(list[i]);
+                w++;
+            }
+            list.resize(w);
+        }
+        if(moved.empty()) continue;
+        hoisted += moved.size();
+
+        // the predecessor itself serves when it only leads into the loop
+        BlockIdx pre = pred;
+        if(cfg.blocks[pred].succs.size() != 1){
+            int32_t headLabel = cfg.blocks[h].label;
+            int32_t predLabel = cfg.blocks[pred].label;
+            int32_t preLabel = f.newLabel();
+            pre = code.size();
+            code.emplace_back();
+            origin.push_back(origin[pred]);
+            headerOf.push_back(h);
+            IRInstr label;
+            label.cmd = IRCmd::LLABEL;
+            label.imm = preLabel;
+            code[pre].push_back(label);
+
+            // branches into the header now go through the preheader
+            IRInstr& last = code[pred].back();
+            bool jumps = false;
+            if(hasLabelImm(last.cmd) && last.cmd != IRCmd::LLABEL){
+                if(last.imm == headLabel){
+                    last.imm = preLabel;
+                    jumps = true;
+                }
+                for(auto& lb : last.labels){
+                    if(lb == headLabel){
+                        lb = preLabel;
+                        jumps = true;
+                    }
+                }
+            }
+            preheadersOf[origin[pred]].push_back(pre);
+            if(jumps){
+                IRInstr jmp;
+                jmp.cmd = IRCmd::JMP;
+                jmp.imm = headLabel;
+                moved.push_back(jmp);
+                appended.push_back(pre);
+            } else {
+                placeBefore[h] = pre;           // between pred and header, falling through
+            }
+            for(auto& ins : code[h]){
+                if(ins.cmd != IRCmd::PHI) continue;
+                for(auto& lb : ins.labels){
+                    if(lb == predLabel) lb = preLabel;
+                }
+            }
+        }
+        for(auto& ins : moved){
+            if(ins.t >= 0) defBlock[ins.t] = pre;
+        }
+        auto& dest = code[pre];
+        auto pos = dest.end();
+        if(pre == pred && !dest.empty() && isTerminator(dest.back().cmd)) pos--;
+        dest.insert(pos, std::make_move_iterator(moved.begin()), std::make_move_iterator(moved.end()));
+    }
+
+    stats.add("licm.hoisted", hoisted);
+    if(hoisted == 0) return;
+
+    pool.clear();
+    auto emit = [&](BlockIdx b){
+        for(auto& ins : code[b]){
+            pool.push_back(std::move(ins));
+        }
+    };
+    for(size_t b = 0; b < nB; b++){
+        if(placeBefore[b] >= 0) emit(placeBefore[b]);
+        emit(b);
+    }
+    for(auto b : appended){
+        emit(b);
+    }
+    cfg.build(f);
+}
@@ -0,0 +1,132 @@
+#include "link.h"
+#include "elf64.h"
+
+#include <cstdio>
+#include <cstring>
+#include <set>
+
+namespace {
+
+using Section = ObjectCode::Section;
+
+void align(std::vector<uint8_t>& b, size_t a){
+    while(b.size() % a){
+        b.push_back(0);
+    }
+}
+
+} // namespace
+
+uint64_t Linker::addressOf(Section s, uint64_t offset) const{
+    return ((s == Section::Text) ? textAddr : rodataAddr) + offset;
+}
+
+void Linker::add(const ObjectCode& obj){
+    align(image.text, 16);
+    align(image.rodata, 8);
+    uint64_t textBase = image.text.size();
+    uint64_t rodataBase = image.rodata.size();
+    auto base = [&](Section s){ return (s == Section::Text) ? textBase : rodataBase; };
+    image.text.insert(image.text.end(), obj.text.begin(), obj.text.end());
+    image.rodata.insert(image.rodata.end(), obj.rodata.begin(), obj.rodata.end());
+
+    for(auto& sym : obj.symbols){
+        if(!sym.global || sym.section == Section::Undef) continue;
+        if(globals.count(sym.name)){
+            fprintf(stderr, "Link error: duplicate symbol '%s'\n", sym.name.c_str());
+            exit(1);
+        }
+        globals[sym.name] = {sym.section, base(sym.section) + sym.offset};
+        image.symbols.push_back({sym.name, sym.section, base(sym.section) + sym.offset, true});
+    }
+    for(auto r : obj.relocs){
+        r.offset += base(r.section);
+        if(r.sym.empty()) r.addend += base(r.target);
+        image.relocs.push_back(r);
+    }
+}
+
+void Linker::addStartup(){
+    auto op = [](const char* name, std::vector<MOperand> opnds){
+        return MInstr{MInstr::Kind::Op, name, std::move(opnds)};
+    };
+    MOperand ebp = MOperand::r(PhysReg::RBP, 4);
+    ObjectCode start;
+    X86Encoder enc(start);
+    enc.add({
+        MInstr::directive(".global", {MOperand::label("_start")}),
+        MInstr::label("_start"),
+        op("xor", {ebp, ebp}),                  // marks the outermost frame
+        op("call", {MOperand::label("main")}),
+        op("mov", {MOperand::r(PhysReg::RDI), MOperand::r(PhysReg::RAX)}),
+        op("call", {MOperand::label("exit")}),
+    });
+    enc.finish();
+    add(start);
+}
+
+void Linker::addExterns(const std::vector<std::pair<std::string, const void*>>& funcs){
+    ObjectCode stubs;
+    for(auto& [name, fn] : funcs){
+        // jmp qword ptr [rip + 0] with the address right behind it
+        stubs.symbols.push_back({name, Section::Text, stubs.text.size(), true});
+        stubs.text.insert(stubs.text.end(), {0xff, 0x25, 0, 0, 0, 0});
+        uint64_t addr = reinterpret_cast<uint64_t>(fn);
+        for(int32_t k = 0; k < 8; k++){
+            stubs.text.push_back((uint8_t)(addr >> (8 * k)));
+        }
+        while(stubs.text.size() % 8){
+            stubs.text.push_back(0xcc);
+        }
+    }
+    add(stubs);
+}
+
+uint64_t Linker::address(const std::string& name) const{
+    auto it = globals.find(name);
+    if(it == globals.end()) return 0;
+    return addressOf(it->second.section, it->second.offset);
+}
+
+void Linker::relocate(uint64_t text, uint64_t rodata){
+    textAddr = text;
+    rodataAddr = rodata;
+    std::set<std::string> undefined;
+    for(auto& r : image.relocs){
+        uint64_t s;
+        if(r.sym.empty()){
+            s = addressOf(r.target, 0);
+        } else {
+            auto it = globals.find(r.sym);
+            if(it == globals.end()){
+                undefined.insert(r.sym);
+                continue;
+            }
+            s = addressOf(it->second.section, it->second.offset);
+        }
+        int64_t v = (int64_t)(s + r.addend - addressOf(r.section, r.offset));
+        if(v != (int32_t)v){
+            fprintf(stderr, "Link error: relocation against '%s' out of range\n", r.sym.c_str());
+            exit(1);
+        }
+        int32_t v32 = (int32_t)v;
+        memcpy(&image.bytes(r.section)[r.offset], &v32, 4);
+    }
+    if(!undefined.empty()){
+        for(auto& name : undefined){
+            fprintf(stderr, "Link error: undefined reference to '%s'\n", name.c_str());
+        }
+        exit(1);
+    }
+}
+
+void Linker::writeExecutable(const std::string& path){
+    auto entry = globals.find("_start");
+    if(entry == globals.end()){
+        fprintf(stderr, "Link error: no _start\n");
+        exit(1);
+    }
+    ElfLayout layout = elfExecutableLayout(image);
+    relocate(layout.textAddr, layout.rodataAddr);
+    writeElfExecutable(image, layout, addressOf(entry->second.section, entry->second.offset), path);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "encode_x86-64.h"
+
+/// Static linker over ObjectCode modules. add() appends a module's
+/// sections to one image and collects its global symbols; relocate()
+/// resolves every reference for the addresses the image is loaded at.
+/// writeExecutable() lays the image out as a static non-PIE ELF
+/// executable entered at _start; the JIT instead loads it into memory
+/// with host functions standing in for the standard library.
+class Linker{
+    struct Place{
+        ObjectCode::Section section;
+        uint64_t offset;
+    };
+    ObjectCode image;
+    std::unordered_map<std::string, Place> globals;
+    uint64_t textAddr = 0;
+    uint64_t rodataAddr = 0;
+
+    uint64_t addressOf(ObjectCode::Section s, uint64_t offset) const;
+public:
+    void add(const ObjectCode& obj);
+    void addStartup();                              // _start: exit(main())
+    // a stub per function jumping to its absolute address, so calls reach
+    // host code however far away the image is loaded
+    void addExterns(const std::vector<std::pair<std::string, const void*>>& funcs);
+    void relocate(uint64_t text, uint64_t rodata);
+    void writeExecutable(const std::string& path);
+
+    const ObjectCode& getImage() const { return image; }
+    uint64_t address(const std::string& name) const;    // after relocate; 0 if undefined
+};
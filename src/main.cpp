@@ -10,7 +10,18 @@ void printUsage(const char* progName) {
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  -c <code>     : Compile code string directly\n");
     fprintf(stderr, "  -o <output.s> : Output assembly file (default: out.s)\n");
+    fprintf(stderr, "                  a name ending in .o writes an ELF object instead\n");
+    fprintf(stderr, "  --link        : Write a static executable linked with std (default: a.out)\n");
+    fprintf(stderr, "  --run         : Run main in-process and exit with its result\n");
     fprintf(stderr, "  -i <tnlibdir>: Specify tnlib directory\n");
+    fprintf(stderr, "  --emit-cfg    : Print the control flow graph of each function as dot\n");
+    fprintf(stderr, "  --stats       : Print optimization counters to stderr\n");
+    fprintf(stderr, "  -O<0|1|2>     : Optimization level (default: 1)\n");
+    fprintf(stderr, "  --inline-threshold=<n> : Largest function size to inline\n");
+    fprintf(stderr, "  --passes=<a,b,...> : Run these passes instead of the -O preset\n");
+    fprintf(stderr, "                       (mem2reg, sccp, gvn, licm, strength, dce)\n");
+    fprintf(stderr, "  --time-passes : Print the time spent in each pass to stderr\n");
+    fprintf(stderr, "  --bench-tokenizer : Print tokenizer throughput on the input and stop\n");
     fprintf(stderr, "Examples:\n");
     fprintf(stderr, "  %s source.tn              # Compile file\n", progName);
     fprintf(stderr, "  %s -c \"fn main() {...}\"   # Compile string\n", progName);
@@ -24,7 +35,16 @@ int main(int argc, char** argv) {
 
     const char* inputFile = nullptr;
     const char* codeString = nullptr;
-    const char* outputFile = "out.s";
+    const char* outputFile = nullptr;
+    bool emitCFG = false;
+    bool stats = false;
+    int optLevel = 1;
+    int inlineThreshold = -1;
+    const char* passes = nullptr;
+    bool timePasses = false;
+    bool benchTokenizer = false;
+    bool link = false;
+    bool run = false;
 
     ModulePath modulePath;
     modulePath.addDirPath("."); // current directory
@@ -53,6 +73,24 @@ int main(int argc, char** argv) {
                 return 1;
             }
             modulePath.addDirPath(argv[++i]);
+        } else if(strcmp(argv[i], "--emit-cfg") == 0){
+            emitCFG = true;
+        } else if(strcmp(argv[i], "--stats") == 0){
+            stats = true;
+        } else if(strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O2") == 0){
+            optLevel = argv[i][2] - '0';
+        } else if(strncmp(argv[i], "--inline-threshold=", 19) == 0){
+            inlineThreshold = atoi(argv[i] + 19);
+        } else if(strncmp(argv[i], "--passes=", 9) == 0){
+            passes = argv[i] + 9;
+        } else if(strcmp(argv[i], "--time-passes") == 0){
+            timePasses = true;
+        } else if(strcmp(argv[i], "--bench-tokenizer") == 0){
+            benchTokenizer = true;
+        } else if(strcmp(argv[i], "--link") == 0){
+            link = true;
+        } else if(strcmp(argv[i], "--run") == 0){
+            run = true;
         } else if(argv[i][0] == '-'){
             fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
             printUsage(argv[0]);
@@ -81,10 +119,22 @@ int main(int argc, char** argv) {
     }
 
     moduleSet loadedModules;
+    std::string output = outputFile ? outputFile : (link ? "a.out" : "out.s");
 
     CompileOptions options{
+        .emitObject = !link && output.size() > 2 && output.ends_with(".o"),
+        .link = link,
+        .run = run,
+        .emitCFG = emitCFG,
+        .stats = stats,
+        .optLevel = optLevel,
+        .inlineThreshold = inlineThreshold,
+        .customPasses = passes != nullptr,
+        .passes = passes ? passes : "",
+        .timePasses = timePasses,
+        .benchTokenizer = benchTokenizer,
         .modulePath = modulePath,
-        .output_file = std::string(outputFile),
+        .output_file = output,
         .loadedModules = loadedModules
     };
 
@@ -96,5 +146,5 @@ int main(int argc, char** argv) {
         compiler.compileFile(inputFile);
     }
 
-    return 0;
+    return (int)compiler.result();
 }
\ No newline at end of file
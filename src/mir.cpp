@@ -0,0 +1,204 @@
+#include "mir.h"
+
+#include <format>
+
+namespace {
+
+const char* regName(PhysReg r, uint8_t size){
+    static const char* names[][3] = {
+        {"none", "none", "none"},
+        {"r10", "r10d", "r10b"},
+        {"r11", "r11d", "r11b"},
+        {"r12", "r12d", "r12b"},
+        {"r13", "r13d", "r13b"},
+        {"r14", "r14d", "r14b"},
+        {"r15", "r15d", "r15b"},
+        {"rax", "eax", "al"},
+        {"rdi", "edi", "dil"},
+        {"rsi", "esi", "sil"},
+        {"rdx", "edx", "dl"},
+        {"rcx", "ecx", "cl"},
+        {"r8", "r8d", "r8b"},
+        {"r9", "r9d", "r9b"},
+        {"rbp", "ebp", "bpl"},
+        {"rsp", "esp", "spl"},
+        {"rip", "eip", "none"},
+    };
+    return names[(size_t)r][size == 8 ? 0 : size == 4 ? 1 : 2];
+}
+
+} // namespace
+
+MOperand MOperand::r(PhysReg reg, uint8_t size){
+    MOperand o;
+    o.kind = Kind::Reg;
+    o.reg = reg;
+    o.size = size;
+    return o;
+}
+
+MOperand MOperand::v(VRegID vid, uint8_t size){
+    MOperand o;
+    o.kind = Kind::VReg;
+    o.vreg = vid;
+    o.size = size;
+    return o;
+}
+
+MOperand MOperand::i(int64_t val){
+    MOperand o;
+    o.kind = Kind::Imm;
+    o.imm = val;
+    return o;
+}
+
+MOperand MOperand::m(PhysReg base, int64_t disp, uint8_t size){
+    MOperand o;
+    o.kind = Kind::Mem;
+    o.reg = base;
+    o.imm = disp;
+    o.size = size;
+    return o;
+}
+
+MOperand MOperand::mv(VRegID base, int64_t disp, uint8_t size){
+    MOperand o = m(PhysReg::None, disp, size);
+    o.vreg = base;
+    return o;
+}
+
+MOperand MOperand::label(std::string name){
+    MOperand o;
+    o.kind = Kind::Label;
+    o.sym = std::move(name);
+    return o;
+}
+
+bool MOperand::reads(PhysReg r) const{
+    switch(kind){
+        case Kind::Reg: return reg == r;
+        case Kind::Mem: return reg == r || index == r;
+        default: return false;
+    }
+}
+
+std::string MOperand::text() const{
+    switch(kind){
+        case Kind::Reg:
+            return regName(reg, size);
+        case Kind::VReg:
+            return std::format("%{}", vreg);
+        case Kind::Imm:
+            return std::to_string(imm);
+        case Kind::Label:
+            return sym;
+        case Kind::Mem:
+        {
+            std::string addr = (vreg >= 0) ? std::format("%{}", vreg) : regName(reg, 8);
+            if(!sym.empty()) addr += " + " + sym;
+            if(vindex >= 0) addr += std::format(" + %{} * {}", vindex, scale);
+            if(index != PhysReg::None) addr += std::format(" + {} * {}", regName(index, 8), scale);
+            if(imm < 0) addr += std::format(" - {}", -imm);
+            if(imm > 0) addr += std::format(" + {}", imm);
+            const char* ptr = (size == 8) ? "qword ptr " : (size == 4) ? "dword ptr " : "";
+            return std::format("{}[{}]", ptr, addr);
+        }
+        default:
+            return "";
+    }
+}
+
+std::string MInstr::text() const{
+    switch(kind){
+        case Kind::Label:
+            return op + ":";
+        case Kind::Directive:
+        {
+            bool data = op == ".align" || op == ".long";
+            std::string s = data ? "  " + op : op;
+            if(op == ".long" && opnds.size() == 2){
+                return s + " " + opnds[0].text() + " - " + opnds[1].text();
+            }
+            for(auto& o : opnds){
+                s += " " + o.text();
+            }
+            return s;
+        }
+        default:
+            break;
+    }
+    std::string s = "  " + op;
+    for(size_t k = 0; k < opnds.size(); k++){
+        s += (k == 0) ? " " : ", ";
+        s += opnds[k].text();
+    }
+    return s;
+}
+
+void FrameLowering::run(){
+    auto& code = mf.code;
+    uint32_t written = 0;
+    bool hasCall = false;
+    for(auto& ins : code){
+        if(ins.kind != MInstr::Kind::Op) continue;
+        hasCall |= ins.op == "call";
+        for(auto& o : ins.opnds){
+            if(o.kind == MOperand::Kind::Reg) written |= 1u << (uint32_t)o.reg;
+        }
+    }
+    std::vector<PhysReg> saved;
+    for(auto r : {PhysReg::R12, PhysReg::R13, PhysReg::R14, PhysReg::R15}){
+        if(written & (1u << (uint32_t)r)) saved.push_back(r);
+    }
+    bool hasFrame = mf.frameSize > 0;
+    uint32_t pushed = saved.size() * 8;
+    uint32_t pad = 0;
+    if(hasFrame){
+        // rsp is 16-byte aligned right after push rbp
+        pad = ((mf.frameSize + pushed + 15) & ~15u) - pushed;
+    } else if(hasCall && pushed % 16 == 0){
+        // rsp is 8 bytes off 16 at entry
+        pad = 8;
+    }
+
+    auto op = [](const char* name, std::vector<MOperand> opnds){
+        return MInstr{MInstr::Kind::Op, name, std::move(opnds)};
+    };
+    MOperand rbp = MOperand::r(PhysReg::RBP), rsp = MOperand::r(PhysReg::RSP);
+    std::vector<MInstr> prologue, epilogue;
+    if(hasFrame){
+        prologue.push_back(op("push", {rbp}));
+        prologue.push_back(op("mov", {rbp, rsp}));
+    }
+    if(pad){
+        prologue.push_back(op("sub", {rsp, MOperand::i(pad)}));
+    }
+    for(auto r : saved){
+        prologue.push_back(op("push", {MOperand::r(r)}));
+    }
+    // leaves rsp at the return address
+    for(auto r = saved.rbegin(); r != saved.rend(); r++){
+        epilogue.push_back(op("pop", {MOperand::r(*r)}));
+    }
+    if(hasFrame){
+        epilogue.push_back(op("mov", {rsp, rbp}));
+        epilogue.push_back(op("pop", {rbp}));
+    } else if(pad){
+        epilogue.push_back(op("add", {rsp, MOperand::i(pad)}));
+    }
+
+    std::vector<MInstr> out;
+    out.reserve(code.size() + prologue.size() + epilogue.size() * 2);
+    for(auto& ins : code){
+        if(ins.is("epilogue")){
+            out.insert(out.end(), epilogue.begin(), epilogue.end());
+            continue;
+        }
+        bool entry = ins.kind == MInstr::Kind::Label && ins.op == mf.name;
+        out.push_back(std::move(ins));
+        if(entry){
+            out.insert(out.end(), prologue.begin(), prologue.end());
+        }
+    }
+    code.swap(out);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gen_ir.h"
+
+/// Operand of a machine instruction. Registers start out virtual (a VReg
+/// of the IR function) and are replaced by their physical register or
+/// spill slot once allocation has been applied.
+class MOperand{
+public:
+    enum class Kind : uint8_t { None, Reg, VReg, Imm, Mem, Label };
+    Kind kind = Kind::None;
+    uint8_t size = 8;                   // bytes: Reg 8/4/1, Mem 8/4, or 0 for a bare address (lea)
+    PhysReg reg = PhysReg::None;        // Reg; base of Mem (RIP with sym for rip-relative)
+    PhysReg index = PhysReg::None;      // Mem
+    VRegID vreg = -1;                   // VReg; virtual base of Mem
+    VRegID vindex = -1;                 // virtual index of Mem
+    uint8_t scale = 1;                  // Mem
+    int64_t imm = 0;                    // Imm value, Mem displacement
+    std::string sym;                    // Label; Mem rip-relative symbol
+
+    static MOperand r(PhysReg reg, uint8_t size = 8);
+    static MOperand v(VRegID vid, uint8_t size = 8);
+    static MOperand i(int64_t val);
+    static MOperand m(PhysReg base, int64_t disp, uint8_t size = 8);
+    static MOperand mv(VRegID base, int64_t disp, uint8_t size = 8);
+    static MOperand label(std::string name);
+
+    bool isReg(PhysReg r) const { return kind == Kind::Reg && reg == r; }
+    bool reads(PhysReg r) const;        // r takes part in the operand's value or address
+    bool operator==(const MOperand&) const = default;
+    std::string text() const;
+};
+
+/// One line of a function's output: an instruction, a label or a directive.
+/// Directives are .global, .section, .text, .align and .long; a .long with
+/// two label operands stores their difference.
+class MInstr{
+public:
+    enum class Kind : uint8_t { Op, Label, Directive };
+    Kind kind = Kind::Op;
+    std::string op;                     // mnemonic, label name or directive
+    std::vector<MOperand> opnds;        // Intel order, destination first
+
+    static MInstr label(std::string name) { return {Kind::Label, std::move(name), {}}; }
+    static MInstr directive(std::string name, std::vector<MOperand> opnds = {}){
+        return {Kind::Directive, std::move(name), std::move(opnds)};
+    }
+    bool is(const char* mnemonic) const { return kind == Kind::Op && op == mnemonic; }
+    std::string text() const;
+};
+
+/// Machine code of one function, from instruction selection to text.
+/// X86Generator lowers the IR into it with virtual registers, then runs
+/// the machine passes in order: RegAlloc::rewrite puts in the allocated
+/// registers, FrameLowering adds the prologue and epilogues, Peephole
+/// cleans up, and the last step prints each instruction.
+class MFunction{
+public:
+    std::string name;
+    uint32_t frameSize = 0;             // bytes of locals and spill slots below rbp
+    std::vector<MInstr> code;
+};
+
+/// Builds the stack frame once the registers are known.
+///   push rbp / mov rbp, rsp     only when there are frame slots
+///   sub rsp, pad                keeps rsp 16-byte aligned at calls
+///   push r12 ... r15            only the callee-saved registers written
+/// The prologue goes behind the function label and every `epilogue`
+/// pseudo instruction left by lowering is expanded to undo it.
+class FrameLowering{
+    MFunction& mf;
+public:
+    FrameLowering(MFunction& m) : mf(m) {}
+    void run();
+};
+
+/// Peephole optimizer over a function's machine instructions.
+/// Rules from a table are tried at every position until none applies:
+/// self-moves, a move straight back, a register written twice without a
+/// read, jumps to the next label, and mov reg, 0 becoming xor where the
+/// flags are dead. Each rule looks at a short window and rewrites it in
+/// place; adding one is adding a function and a table row. Local labels no
+/// jump refers to are dropped between rounds so windows span them.
+class Peephole{
+    std::vector<MInstr>& code;
+public:
+    Peephole(std::vector<MInstr>& c) : code(c) {}
+    uint64_t run();                     // instructions removed or rewritten
+};
@@ -0,0 +1,19 @@
+#include "opt.h"
+
+#include <cstdio>
+
+void OptStats::add(const std::string& name, uint64_t n){
+    for(auto& [key, count] : counters){
+        if(key == name){
+            count += n;
+            return;
+        }
+    }
+    counters.push_back({name, n});
+}
+
+void OptStats::print() const{
+    for(auto& [key, count] : counters){
+        fprintf(stderr, "%-24s %llu\n", key.c_str(), (unsigned long long)count);
+    }
+}
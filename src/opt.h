@@ -0,0 +1,189 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gen_ir.h"
+#include "cfg.h"
+
+/// SSA construction.
+/// Frame slots accessed only through FRAME_ADDR + LOAD/SAVE (every local and
+/// parameter, since Tane has no address-of operator) and temporaries that are
+/// assigned more than once are renamed into single-assignment vregs, with PHI
+/// nodes placed on the iterated dominance frontier where the value is live.
+/// Plain copies are folded away while renaming.
+class Mem2Reg{
+    struct PhiNode{
+        int32_t var;
+        VRegID dst;
+        std::vector<VRegID> in;     // one per predecessor, in CFG pred order
+    };
+    IRFunc& f;
+    VRegID zero = -1;               // value of a variable read before assignment
+public:
+    Mem2Reg(IRFunc& func) : f(func) {}
+    void run();
+};
+
+/// SSA destruction.
+/// Each PHI becomes a parallel copy at the end of its predecessors; critical
+/// edges are split first so the copies only run on the incoming edge.
+class PhiElim{
+    IRFunc& f;
+    void emitCopies(std::vector<std::pair<VRegID, VRegID>> copies, std::vector<IRInstr>& out);
+public:
+    PhiElim(IRFunc& func) : f(func) {}
+    void run();
+};
+
+/// Counters reported by --stats.
+class OptStats{
+    std::vector<std::pair<std::string, uint64_t>> counters;     // in first-reported order
+public:
+    void add(const std::string& name, uint64_t n);
+    void print() const;
+};
+
+/// Sparse conditional constant propagation (Wegman & Zadeck) on SSA form.
+/// Values are only propagated along edges found executable, so constants
+/// flowing into a branch prune the other side. Instructions with a known
+/// result become MOV_IMM, branches on known conditions become JMP or fall
+/// through, and blocks never reached are dropped.
+class SCCP{
+    enum class Lattice : uint8_t { Undef, Const, Over };
+    struct Value{
+        Lattice state = Lattice::Undef;
+        int64_t val = 0;
+    };
+    IRFunc& f;
+    OptStats& stats;
+    std::vector<Value> values;
+
+    Value evaluate(const IRInstr& ins);
+public:
+    SCCP(IRFunc& func, OptStats& st) : f(func), stats(st) {}
+    void run();
+};
+
+/// Dominator-based value numbering on SSA form.
+/// Walking the dominator tree with a scoped table of (op, operands) keys,
+/// a pure instruction equal to one in a dominating position (the same
+/// block included) is dropped and its uses renamed to the earlier vreg.
+/// Copies and PHIs whose inputs are all the same value are folded too.
+class GVN{
+    IRFunc& f;
+    OptStats& stats;
+public:
+    GVN(IRFunc& func, OptStats& st) : f(func), stats(st) {}
+    void run();
+};
+
+/// Loop-invariant code motion on SSA form.
+/// Natural loops are found from back edges in the dominator tree. A pure
+/// instruction whose operands are all defined outside a loop moves to the
+/// end of the loop's preheader, which is split off the single entering
+/// predecessor when that one also branches elsewhere. Inner loops go first,
+/// so invariants climb out of a whole nest. Divisions move only when the
+/// divisor is a constant that cannot trap.
+class LICM{
+    IRFunc& f;
+    OptStats& stats;
+public:
+    LICM(IRFunc& func, OptStats& st) : f(func), stats(st) {}
+    void run();
+};
+
+/// Strength reduction of induction variables on SSA form.
+/// A header PHI advanced by a constant step on the loop's single back edge
+/// is an induction variable i. A multiplication i * k, with k constant or
+/// defined outside the loop, becomes a new induction variable starting at
+/// init * k in the preheader and advanced by step * k next to i, so the
+/// loop body adds instead of multiplying.
+class StrengthReduce{
+    IRFunc& f;
+    OptStats& stats;
+public:
+    StrengthReduce(IRFunc& func, OptStats& st) : f(func), stats(st) {}
+    void run();
+};
+
+/// Dead code elimination on SSA form.
+/// Blocks unreachable from the entry are dropped first. A SAVE to a frame
+/// slot that is overwritten or left unread is a dead store. Everything else
+/// is kept only if calls, stores, branches or returns depend on it, found by
+/// marking backwards through the operands. Divisions count as side effects
+/// unless the divisor is a constant that cannot trap.
+class DCE{
+    IRFunc& f;
+    OptStats& stats;
+    uint64_t removeUnreachable();
+    uint64_t markDeadStores(std::vector<bool>& dead);
+public:
+    DCE(IRFunc& func, OptStats& st) : f(func), stats(st) {}
+    void run();
+};
+
+/// Inlining of small functions, on the IR straight from IRGenerator.
+/// Callees are cloned into their call sites with fresh vregs, labels and
+/// frame slots; PARAM becomes a copy of the argument and RET a copy to the
+/// call's result plus a jump past the body (a TAILCALL keeps the callee's
+/// RETs). Functions are visited callees
+/// first (strongly connected components of the call graph), so inlined
+/// bodies are already inlined themselves, and calls inside a cycle are
+/// never inlined. Imported functions are inlined when their .tnlib carries
+/// the body.
+class Inliner{
+    IRModule& m;
+    OptStats& stats;
+    uint32_t threshold;                         // largest callee cost inlined
+    std::vector<IRFunc> imported;               // decoded .tnlib bodies
+    std::unordered_map<SymbolIdx, int32_t> importedOf;
+
+    const IRFunc* calleeOf(const IRInstr& call, size_t& funcIdx);
+    void inlineCall(IRFunc& caller, const IRInstr& call, const IRFunc& callee, std::vector<IRInstr>& out);
+public:
+    Inliner(IRModule& mod, OptStats& st, uint32_t limit) : m(mod), stats(st), threshold(limit) {}
+    void run();
+};
+
+/// Consistency checks run between passes in debug builds.
+/// The CFG must match the instruction list, jumps and PHI inputs must name
+/// existing labels and predecessors, every vreg read must be defined, and a
+/// vreg defined once must be defined in a block dominating its uses. A
+/// failure names the pass that broke the function and stops the compiler.
+class IRVerifier{
+    IRFunc& f;
+    const char* after;
+    [[noreturn]] void fail(const std::string& msg) const;
+public:
+    IRVerifier(IRFunc& func, const char* passName) : f(func), after(passName) {}
+    void run();
+};
+
+/// Ordered list of optimization passes.
+/// The inliner runs over the whole module first when its threshold is
+/// non-zero, then the per-function passes run in the order given, either
+/// an -O preset or a --passes= list, and PhiElim takes every function out
+/// of SSA form last. With timing on, the time spent in each pass is printed
+/// to stderr; debug builds verify the IR after every pass.
+class PassManager{
+    using PassFn = void (*)(IRFunc&, OptStats&);
+    struct Pass{
+        const char* name;
+        PassFn run;
+    };
+    static const Pass passes[];
+    std::vector<const Pass*> pipeline;
+    OptStats& stats;
+    uint32_t inlineThreshold = 0;
+    bool timing;
+    std::vector<std::pair<const char*, double>> seconds;   // per pass name, in first-run order
+
+    void addTime(const char* name, double s);
+public:
+    PassManager(OptStats& st, bool timePasses) : stats(st), timing(timePasses) {}
+    void addPreset(int level);
+    void addList(const std::string& list);      // comma separated pass names
+    void setInlineThreshold(uint32_t threshold) { inlineThreshold = threshold; }
+    void run(IRModule& mod);
+};
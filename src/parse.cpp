@@ -16,8 +16,7 @@ ASTIdx Parser::parseFile() {
             ASTNode& importNode = getAST(idx);
             TokenIdx ident = ts.expectIdent();
             ts.expect(TokenKind::Semicolon);
-            Token t = ts.getToken(ident);
-            importNode.name = std::string(t.pos, t.len);
+            importNode.name = std::string(ts.text(ident));
         } else {
             fprintf(stderr, "Unexpected token at top level\n");
             exit(1);
@@ -32,8 +31,7 @@ ASTIdx Parser::parseFile() {
 ASTIdx Parser::functionDef(bool is_pub){
 
     TokenIdx ident = ts.expectIdent();
-    Token t = ts.getToken(ident);
-    std::string fname(t.pos, t.len);
+    std::string fname(ts.text(ident));
 
     std::vector<ASTIdx> params;
 
@@ -42,8 +40,7 @@ ASTIdx Parser::functionDef(bool is_pub){
         do {
             // get parameter name
             TokenIdx paramIdent = ts.expectIdent();
-            Token pt = ts.getToken(paramIdent);
-            std::string pname(pt.pos, pt.len);
+            std::string pname(ts.text(paramIdent));
 
             // create parameter node
             ASTIdx paramNode = newNode(ASTKind::Variable, 0, 0);
@@ -130,8 +127,7 @@ ASTIdx Parser::stmt(){
         ASTIdx n = newNode(ASTKind::VarDecl, 0, 0);
         ASTNode& node = getAST(n);
 
-        Token t = ts.getToken(ident);
-        node.name = std::string(t.pos, t.len);
+        node.name = std::string(ts.text(ident));
         node.setMut(is_mut);
         ts.expect(TokenKind::Semicolon);
         return n;
@@ -145,8 +141,7 @@ ASTIdx Parser::stmt(){
 
             ASTIdx n = newNode(ASTKind::Variable, 0, 0);
             ASTNode& node = getAST(n);
-            Token t = ts.getToken(ident);
-            node.name = std::string(t.pos, t.len);
+            node.name = std::string(ts.text(ident));
 
             ASTIdx rhs = expr();
             ASTIdx assignNode = newNode(ASTKind::Assign, n, rhs);
@@ -329,7 +324,6 @@ ASTIdx Parser::primary(){
     if(auto idxOpt = ts.consumeIdent()){
         // get token
         TokenIdx idx = *idxOpt;
-        Token t = ts.getToken(idx);
 
         if(ts.peekKind(TokenKind::LParen)){
             // function call
@@ -345,23 +339,22 @@ ASTIdx Parser::primary(){
 
             ASTIdx n = newNode(ASTKind::FunctionCall, 0, 0);
             ASTNode& node = getAST(n);
-            node.name = std::string(t.pos, t.len);
+            node.name = std::string(ts.text(idx));
             node.args = std::move(args);
             return n;
         } else {
             ASTIdx n = newNode(ASTKind::Variable, 0, 0);
             ASTNode& node = getAST(n);
-            node.name = std::string(t.pos, t.len);
+            node.name = std::string(ts.text(idx));
             return n;
         }
     }
 
     if(ts.peekKind(TokenKind::StringLiteral)){
         TokenIdx strIdx = ts.expectStringLiteral();
-        Token t = ts.getToken(strIdx);
         ASTIdx n = newNode(ASTKind::StringLiteral, 0, 0);
         ASTNode& node = getAST(n);
-        node.str = std::string(t.pos, t.len);
+        node.str = std::string(ts.text(strIdx));
         return n;
     }
 
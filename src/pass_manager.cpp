@@ -0,0 +1,111 @@
+#include "opt.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+const PassManager::Pass PassManager::passes[] = {
+    {"mem2reg",  [](IRFunc& f, OptStats&){ Mem2Reg(f).run(); }},
+    {"sccp",     [](IRFunc& f, OptStats& st){ SCCP(f, st).run(); }},
+    {"gvn",      [](IRFunc& f, OptStats& st){ GVN(f, st).run(); }},
+    {"licm",     [](IRFunc& f, OptStats& st){ LICM(f, st).run(); }},
+    {"strength", [](IRFunc& f, OptStats& st){ StrengthReduce(f, st).run(); }},
+    {"dce",      [](IRFunc& f, OptStats& st){ DCE(f, st).run(); }},
+};
+
+namespace {
+
+// per-function passes for -O0, -O1 and -O2
+const char* const PRESETS[] = {
+    "",
+    "mem2reg,sccp,gvn,licm,dce",
+    "mem2reg,sccp,gvn,licm,strength,sccp,gvn,dce",
+};
+
+} // namespace
+
+void PassManager::addPreset(int level){
+    addList(PRESETS[std::min(std::max(level, 0), 2)]);
+}
+
+void PassManager::addList(const std::string& list){
+    size_t pos = 0;
+    while(pos < list.size()){
+        size_t comma = list.find(',', pos);
+        if(comma == std::string::npos) comma = list.size();
+        std::string name = list.substr(pos, comma - pos);
+        pos = comma + 1;
+        if(name.empty()) continue;
+
+        const Pass* found = nullptr;
+        for(auto& p : passes){
+            if(name == p.name) found = &p;
+        }
+        if(!found){
+            fprintf(stderr, "Unknown pass: %s\n", name.c_str());
+            fprintf(stderr, "Available passes:");
+            for(auto& p : passes){
+                fprintf(stderr, " %s", p.name);
+            }
+            fprintf(stderr, "\n");
+            exit(1);
+        }
+        pipeline.push_back(found);
+    }
+}
+
+void PassManager::addTime(const char* name, double s){
+    for(auto& [key, total] : seconds){
+        if(strcmp(key, name) == 0){
+            total += s;
+            return;
+        }
+    }
+    seconds.push_back({name, s});
+}
+
+void PassManager::run(IRModule& mod){
+    using Clock = std::chrono::steady_clock;
+    auto timed = [&](const char* name, auto&& body){
+        auto start = Clock::now();
+        body();
+        if(timing){
+            addTime(name, std::chrono::duration<double>(Clock::now() - start).count());
+        }
+    };
+    auto verify = [&](IRFunc& func, const char* name){
+#ifndef NDEBUG
+        IRVerifier(func, name).run();
+#else
+        (void)func;
+        (void)name;
+#endif
+    };
+
+    for(auto& func : mod.funcPool){
+        verify(func, "irgen");
+    }
+    if(inlineThreshold > 0){
+        timed("inline", [&]{ Inliner(mod, stats, inlineThreshold).run(); });
+        for(auto& func : mod.funcPool){
+            verify(func, "inline");
+        }
+    }
+    for(auto& func : mod.funcPool){
+        for(auto pass : pipeline){
+            timed(pass->name, [&]{ pass->run(func, stats); });
+            verify(func, pass->name);
+        }
+        timed("phielim", [&]{ PhiElim(func).run(); });
+        verify(func, "phielim");
+    }
+
+    if(!timing) return;
+    double total = 0;
+    for(auto& [name, s] : seconds){
+        fprintf(stderr, "%-24s %10.3f ms\n", name, s * 1e3);
+        total += s;
+    }
+    fprintf(stderr, "%-24s %10.3f ms\n", "total", total * 1e3);
+}
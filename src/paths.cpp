@@ -23,3 +23,15 @@ std::string ModulePath::resolveTn(const std::string& moduleName){
     }
     return "";
 }
+
+std::string ModulePath::resolveObject(const std::string& moduleName){
+    for(const auto& dir : tnlibDirs){
+        std::string fullPath = dir + "/obj/" + moduleName + ".o";
+        FILE* f = fopen(fullPath.c_str(), "r");
+        if(f != nullptr){
+            fclose(f);
+            return fullPath;
+        }
+    }
+    return "";
+}
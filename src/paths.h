@@ -11,4 +11,6 @@ public:
         tnlibDirs.push_back(path);
     }
     std::string resolveTnlib(const std::string& moduleName);
-    std::string resolveTn(const std::string& moduleName);};
+    std::string resolveTn(const std::string& moduleName);
+    std::string resolveObject(const std::string& moduleName);   // <dir>/obj/<name>.o
+};
@@ -0,0 +1,178 @@
+#include "mir.h"
+
+#include <unordered_set>
+
+namespace {
+
+using Code = std::vector<MInstr>;
+// removed instructions are only marked, and dropped together once a round ends
+using Dead = std::vector<bool>;
+
+bool readsFlags(const MInstr& ins){
+    const std::string& op = ins.op;
+    return (op[0] == 'j' && op != "jmp") || op.starts_with("set") || op.starts_with("cmov")
+        || op == "adc" || op == "sbb";
+}
+
+bool writesFlags(const MInstr& ins){
+    static const char* const ops[] = {
+        "cmp", "test", "add", "sub", "and", "or", "xor", "shl", "shr", "sar",
+        "neg", "imul", "idiv", "inc", "dec",
+    };
+    for(auto op : ops){
+        if(ins.op == op) return true;
+    }
+    return false;
+}
+
+// the first instruction after i not yet removed, or code.size()
+size_t nextLive(const Code& code, const Dead& dead, size_t i){
+    size_t j = i + 1;
+    while(j < code.size() && dead[j]) j++;
+    return j;
+}
+
+// Nothing after i reads the flags before they are set again. Flags never
+// live across a label, a jump or a call in generated code.
+bool flagsDead(const Code& code, const Dead& dead, size_t i){
+    for(size_t j = nextLive(code, dead, i); j < code.size(); j = nextLive(code, dead, j)){
+        const MInstr& ins = code[j];
+        if(ins.kind != MInstr::Kind::Op) return true;
+        if(readsFlags(ins)) return false;
+        if(writesFlags(ins) || ins.op == "jmp" || ins.op == "call" || ins.op == "ret") return true;
+    }
+    return true;
+}
+
+bool isReg64(const MOperand& o){
+    return o.kind == MOperand::Kind::Reg && o.size == 8;
+}
+
+// both instructions at i and at j, the next one, with no label between them
+bool pairAt(const Code& code, const Dead& dead, size_t i, size_t& j){
+    j = nextLive(code, dead, i);
+    return j < code.size() && code[i].kind == MInstr::Kind::Op && code[j].kind == MInstr::Kind::Op;
+}
+
+// mov r, r
+bool selfMove(Code& code, Dead& dead, size_t i){
+    const MInstr& ins = code[i];
+    if(!ins.is("mov") || !isReg64(ins.opnds[0]) || ins.opnds[0] != ins.opnds[1]) return false;
+    dead[i] = true;
+    return true;
+}
+
+// mov a, b / mov b, a: the second copy changes nothing
+bool moveBack(Code& code, Dead& dead, size_t i){
+    size_t j;
+    if(!pairAt(code, dead, i, j) || !code[i].is("mov") || !code[j].is("mov")) return false;
+    const MOperand& a = code[i].opnds[0];
+    const MOperand& b = code[i].opnds[1];
+    if(code[j].opnds[0] != b || code[j].opnds[1] != a) return false;
+    bool regA = isReg64(a), regB = isReg64(b);
+    bool memA = a.kind == MOperand::Kind::Mem && a.size == 8;
+    bool memB = b.kind == MOperand::Kind::Mem && b.size == 8;
+    if(!((regA && (regB || memB)) || (regB && memA))) return false;
+    if((memA && a.reads(b.reg)) || (memB && b.reads(a.reg))) return false;
+    dead[j] = true;
+    return true;
+}
+
+// mov r, x / mov r, y: the first value is never read
+bool deadMove(Code& code, Dead& dead, size_t i){
+    size_t j;
+    if(!pairAt(code, dead, i, j) || !code[i].is("mov")) return false;
+    const MInstr& next = code[j];
+    const MOperand& r = code[i].opnds[0];
+    if(!isReg64(r) || !(next.is("mov") || next.is("lea"))) return false;
+    if(next.opnds[0] != r || next.opnds[1].reads(r.reg)) return false;
+    dead[i] = true;
+    return true;
+}
+
+// jmp L straight before L:
+bool jumpToNext(Code& code, Dead& dead, size_t i){
+    const MInstr& ins = code[i];
+    if(!ins.is("jmp") || ins.opnds[0].kind != MOperand::Kind::Label) return false;
+    for(size_t j = nextLive(code, dead, i); j < code.size() && code[j].kind == MInstr::Kind::Label; j = nextLive(code, dead, j)){
+        if(code[j].op == ins.opnds[0].sym){
+            dead[i] = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+// mov r, 0 -> xor r32, r32, which is shorter and breaks the dependency
+bool zeroIdiom(Code& code, Dead& dead, size_t i){
+    MInstr& ins = code[i];
+    if(!ins.is("mov") || !isReg64(ins.opnds[0])) return false;
+    if(ins.opnds[1].kind != MOperand::Kind::Imm || ins.opnds[1].imm != 0 || !flagsDead(code, dead, i)) return false;
+    MOperand r = MOperand::r(ins.opnds[0].reg, 4);
+    ins.op = "xor";
+    ins.opnds = {r, r};
+    return true;
+}
+
+struct Rule{
+    const char* name;
+    bool (*apply)(Code& code, Dead& dead, size_t i);
+};
+
+const Rule rules[] = {
+    {"self-move",    selfMove},
+    {"move-back",    moveBack},
+    {"dead-move",    deadMove},
+    {"jump-to-next", jumpToNext},
+    {"zero-idiom",   zeroIdiom},
+};
+
+// Drop local labels nothing refers to, so the rules see across them.
+uint64_t removeUnusedLabels(Code& code){
+    std::unordered_set<std::string> used;
+    for(auto& ins : code){
+        for(auto& o : ins.opnds){
+            if(!o.sym.empty()) used.insert(o.sym);
+        }
+    }
+    size_t w = 0;
+    for(size_t i = 0; i < code.size(); i++){
+        bool local = code[i].kind == MInstr::Kind::Label && code[i].op.starts_with(".L");
+        if(local && !used.count(code[i].op)) continue;
+        if(w != i) code[w] = std::move(code[i]);
+        w++;
+    }
+    uint64_t removed = code.size() - w;
+    code.resize(w);
+    return removed;
+}
+
+} // namespace
+
+uint64_t Peephole::run(){
+    uint64_t applied = 0;
+    bool changed = true;
+    while(changed){
+        applied += removeUnusedLabels(code);
+        changed = false;
+        Dead dead(code.size(), false);
+        for(size_t i = 0; i < code.size(); i++){
+            if(dead[i] || code[i].kind != MInstr::Kind::Op) continue;
+            for(auto& rule : rules){
+                if(rule.apply(code, dead, i)){
+                    applied++;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+        size_t w = 0;
+        for(size_t i = 0; i < code.size(); i++){
+            if(dead[i]) continue;
+            if(w != i) code[w] = std::move(code[i]);
+            w++;
+        }
+        code.resize(w);
+    }
+    return applied;
+}
@@ -0,0 +1,452 @@
+#include "gen_ir.h"
+#include "cfg.h"
+#include "isel.h"
+#include "mir.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+inline uint32_t regBit(PhysReg r){
+    return 1u << static_cast<uint32_t>(r);
+}
+
+// Allocation order: caller-saved scratch registers first so that short-lived
+// temporaries do not touch callee-saved ones, then r12-r15 for values that
+// have to survive a call.
+const PhysReg allocOrder[] = {
+    PhysReg::R10, PhysReg::R11, PhysReg::RSI, PhysReg::RDI, PhysReg::R8, PhysReg::R9,
+    PhysReg::RCX, PhysReg::RDX, PhysReg::RAX,
+    PhysReg::R12, PhysReg::R13, PhysReg::R14, PhysReg::R15,
+};
+
+const uint32_t allocatable =
+    regBit(PhysReg::R10) | regBit(PhysReg::R11) | regBit(PhysReg::R12) | regBit(PhysReg::R13) |
+    regBit(PhysReg::R14) | regBit(PhysReg::R15) | regBit(PhysReg::RAX) | regBit(PhysReg::RDI) |
+    regBit(PhysReg::RSI) | regBit(PhysReg::RDX) | regBit(PhysReg::RCX) | regBit(PhysReg::R8) |
+    regBit(PhysReg::R9);
+
+const uint32_t callerSaved =
+    regBit(PhysReg::RAX) | regBit(PhysReg::RCX) | regBit(PhysReg::RDX) | regBit(PhysReg::RSI) |
+    regBit(PhysReg::RDI) | regBit(PhysReg::R8) | regBit(PhysReg::R9) | regBit(PhysReg::R10) |
+    regBit(PhysReg::R11);
+
+const uint32_t argRegs =
+    regBit(PhysReg::RDI) | regBit(PhysReg::RSI) | regBit(PhysReg::RDX) | regBit(PhysReg::RCX) |
+    regBit(PhysReg::R8) | regBit(PhysReg::R9);
+
+const PhysReg paramRegs[] = {
+    PhysReg::RDI, PhysReg::RSI, PhysReg::RDX, PhysReg::RCX, PhysReg::R8, PhysReg::R9,
+};
+
+// Registers an instruction pins while X86Generator expands it.
+struct Constraint{
+    uint32_t clobber = 0;   // destroyed during the instruction
+    uint32_t src = 0;       // must not hold a source operand
+    uint32_t dst = 0;       // must not hold the target
+};
+
+Constraint constraintOf(const IRInstr& ins, const std::vector<VReg>& vregs){
+    Constraint c;
+    switch(ins.cmd){
+        case IRCmd::DIV:
+        case IRCmd::MOD:
+            // mov rax, s1 / cqo / idiv s2
+            c.clobber = regBit(PhysReg::RAX) | regBit(PhysReg::RDX);
+            c.src = c.clobber;
+            break;
+        case IRCmd::LSHIFT:
+        case IRCmd::RSHIFT:
+            // shift count goes through cl after the target is written
+            if(vregs[ins.s2].kind != VRegKind::Temp) break;
+            c.clobber = regBit(PhysReg::RCX);
+            c.dst = c.clobber;
+            break;
+        case IRCmd::PARAM:
+            // arguments not copied yet still sit in their registers
+            for(int32_t j = ins.imm + 1; j < 6; j++){
+                c.clobber |= regBit(paramRegs[j]);
+            }
+            c.dst = c.clobber;
+            break;
+        case IRCmd::JTABLE:
+            // lea r11, [table] / movsxd rax, [r11 + s1 * 4] / add rax, r11
+            c.clobber = regBit(PhysReg::R11) | regBit(PhysReg::RAX);
+            c.src = regBit(PhysReg::R11);
+            break;
+        case IRCmd::CALL:
+        case IRCmd::TAILCALL:
+            // arguments are moved into rdi, rsi, ... one by one
+            c.clobber = callerSaved;
+            c.src = argRegs;
+            break;
+        default:
+            break;
+    }
+    return c;
+}
+
+template <class F>
+void forEachSrc(IRInstr& ins, F fn){
+    if(ins.s1 >= 0) fn(ins.s1);
+    if(ins.s2 >= 0) fn(ins.s2);
+    for(auto& arg : ins.args){
+        fn(arg);
+    }
+}
+
+} // namespace
+
+// ----------------------------------------------------------------
+// IRFunc::RegAlloc methods
+
+void IRFunc::RegAlloc::run(){
+    unspillable.resize(f.vregs.size(), false);
+
+    while(true){
+        computeUse();
+
+        for(auto& vr : f.vregs){
+            vr.assigned = PhysReg::None;
+        }
+        spilled.assign(f.vregs.size(), false);
+        std::fill(std::begin(regOwner), std::end(regOwner), -1);
+        freeRegs = allocatable;
+        expirePos = 0;
+
+        bool anySpill = false;
+        for(size_t idx = 0; idx < intervals.size(); idx++){
+            expireAt(intervals[idx].start);
+            if(!alloc(idx)){
+                anySpill = true;
+            }
+        }
+        if(!anySpill){
+            break;
+        }
+        rewriteSpills();
+    }
+}
+
+// Everything here is linear in the number of instructions plus the total
+// size of the live ranges, so huge straight-line functions stay cheap.
+void IRFunc::RegAlloc::computeUse(){
+    size_t nV = f.vregs.size();
+    size_t nI = f.instrPool.size();
+    std::vector<int32_t> start(nV, INT32_MAX);
+    std::vector<int32_t> end(nV, -1);
+    auto touch = [&](VRegID v, int32_t pos){
+        if(f.vregs[v].kind != VRegKind::Temp) return;     // folded operand
+        start[v] = std::min(start[v], pos);
+        end[v] = std::max(end[v], pos);
+    };
+
+    const CFG& cfg = f.cfg;
+    size_t nB = cfg.blocks.size();
+
+    // blocks with an upward-exposed use / a def of each vreg
+    std::vector<std::vector<BlockIdx>> useBlocks(nV);
+    std::vector<std::vector<BlockIdx>> defBlocks(nV);
+    std::vector<BlockIdx> lastDef(nV, -1);
+    for(size_t b = 0; b < nB; b++){
+        const BasicBlock& bb = cfg.blocks[b];
+        for(size_t i = bb.begin; i < bb.end; i++){
+            IRInstr& ins = f.instrPool[i];
+            forEachSrc(ins, [&](VRegID v){
+                touch(v, i);
+                if(lastDef[v] != (BlockIdx)b && (useBlocks[v].empty() || useBlocks[v].back() != (BlockIdx)b)){
+                    useBlocks[v].push_back(b);
+                }
+            });
+            if(ins.t >= 0){
+                touch(ins.t, i);
+                if(lastDef[ins.t] != (BlockIdx)b){
+                    defBlocks[ins.t].push_back(b);
+                    lastDef[ins.t] = b;
+                }
+            }
+        }
+    }
+
+    // liveness by walking backwards from each use until the defining
+    // blocks are reached; values used around a back edge therefore stay
+    // live across the whole loop body. Operands ISel folded into their uses
+    // lost their definitions and never get a register, so they are skipped
+    // rather than walked up to the entry block.
+    std::vector<VRegID> defStamp(nB, -1);
+    std::vector<VRegID> inStamp(nB, -1);
+    std::vector<VRegID> outStamp(nB, -1);
+    std::vector<BlockIdx> work;
+    for(size_t v = 0; v < nV; v++){
+        if(useBlocks[v].empty() || f.vregs[v].kind != VRegKind::Temp) continue;
+        for(auto b : defBlocks[v]){
+            defStamp[b] = v;
+        }
+        work.clear();
+        for(auto b : useBlocks[v]){
+            inStamp[b] = v;
+            touch(v, cfg.blocks[b].begin);
+            work.push_back(b);
+        }
+        while(!work.empty()){
+            BlockIdx b = work.back();
+            work.pop_back();
+            for(auto p : cfg.blocks[b].preds){
+                if(outStamp[p] == (VRegID)v) continue;
+                outStamp[p] = v;
+                touch(v, cfg.blocks[p].end - 1);
+                if(defStamp[p] != (VRegID)v && inStamp[p] != (VRegID)v){
+                    inStamp[p] = v;
+                    touch(v, cfg.blocks[p].begin);
+                    work.push_back(p);
+                }
+            }
+        }
+    }
+
+    // registers each interval must avoid; clobbers inside an interval are
+    // found with one prefix count per distinct clobber mask
+    std::vector<uint32_t> forbidden(nV, 0);
+    std::vector<uint32_t> kinds;
+    std::vector<std::vector<int32_t>> kindCount;
+    for(size_t i = 0; i < nI; i++){
+        IRInstr& ins = f.instrPool[i];
+        Constraint c = constraintOf(ins, f.vregs);
+        forEachSrc(ins, [&](VRegID v){ forbidden[v] |= c.src; });
+        if(ins.t >= 0) forbidden[ins.t] |= c.dst;
+        if(c.clobber == 0) continue;
+
+        size_t k = std::find(kinds.begin(), kinds.end(), c.clobber) - kinds.begin();
+        if(k == kinds.size()){
+            kinds.push_back(c.clobber);
+            kindCount.emplace_back(nI + 1, 0);
+        }
+        kindCount[k][i + 1] = 1;
+    }
+    for(auto& cnt : kindCount){
+        for(size_t i = 0; i < nI; i++){
+            cnt[i + 1] += cnt[i];
+        }
+    }
+
+    // bucket intervals by start and by end
+    std::vector<size_t> startBegin(nI + 1, 0);
+    dyingBegin.assign(nI + 1, 0);
+    size_t nIntervals = 0;
+    for(size_t v = 0; v < nV; v++){
+        if(end[v] < 0) continue;
+        startBegin[start[v]]++;
+        dyingBegin[end[v]]++;
+        nIntervals++;
+    }
+    size_t sumS = 0, sumE = 0;
+    for(size_t i = 0; i <= nI; i++){
+        size_t cs = startBegin[i], ce = dyingBegin[i];
+        startBegin[i] = sumS;
+        dyingBegin[i] = sumE;
+        sumS += cs;
+        sumE += ce;
+    }
+
+    intervals.assign(nIntervals, Interval{});
+    dyingList.assign(nIntervals, 0);
+    std::vector<size_t> ends(dyingBegin);
+    for(size_t v = 0; v < nV; v++){
+        if(end[v] < 0) continue;
+        uint32_t fb = forbidden[v];
+        for(size_t k = 0; k < kinds.size(); k++){
+            // clobbers strictly inside (start, end)
+            if(start[v] + 1 < end[v] && kindCount[k][end[v]] - kindCount[k][start[v] + 1] > 0){
+                fb |= kinds[k];
+            }
+        }
+        size_t idx = startBegin[start[v]]++;
+        intervals[idx] = {(VRegID)v, start[v], end[v], fb};
+    }
+    for(size_t idx = 0; idx < nIntervals; idx++){
+        dyingList[ends[intervals[idx].end]++] = idx;
+    }
+}
+
+void IRFunc::RegAlloc::expireAt(int32_t pos){
+    // only the intervals that actually end before pos are touched
+    for(; expirePos < (size_t)pos; expirePos++){
+        for(size_t k = dyingBegin[expirePos]; k < dyingBegin[expirePos + 1]; k++){
+            size_t idx = dyingList[k];
+            PhysReg r = f.vregs[intervals[idx].vid].assigned;
+            if(r != PhysReg::None && regOwner[(uint32_t)r] == (int32_t)idx){
+                regOwner[(uint32_t)r] = -1;
+                freeRegs |= regBit(r);
+            }
+        }
+    }
+}
+
+bool IRFunc::RegAlloc::alloc(size_t idx){
+    Interval& cur = intervals[idx];
+    uint32_t allowed = allocatable & ~cur.forbidden;
+
+    for(auto r : allocOrder){
+        if(allowed & freeRegs & regBit(r)){
+            freeRegs &= ~regBit(r);
+            f.vregs[cur.vid].assigned = r;
+            regOwner[(uint32_t)r] = idx;
+            return true;
+        }
+    }
+
+    // no register left: spill whichever interval ends furthest away
+    PhysReg victim = PhysReg::None;
+    int32_t victimEnd = unspillable[cur.vid] ? INT32_MIN : cur.end;
+    for(auto r : allocOrder){
+        int32_t owner = regOwner[(uint32_t)r];
+        if(owner < 0 || !(allowed & regBit(r))) continue;
+        Interval& it = intervals[owner];
+        if(unspillable[it.vid]) continue;
+        if(it.end > victimEnd){
+            victim = r;
+            victimEnd = it.end;
+        }
+    }
+
+    if(victim == PhysReg::None){
+        if(unspillable[cur.vid]){
+            fprintf(stderr, "No free registers available for VReg %d\n", cur.vid);
+            exit(1);
+        }
+        spilled[cur.vid] = true;
+        return false;
+    }
+
+    Interval& v = intervals[regOwner[(uint32_t)victim]];
+    f.vregs[v.vid].assigned = PhysReg::None;
+    spilled[v.vid] = true;
+    f.vregs[cur.vid].assigned = victim;
+    regOwner[(uint32_t)victim] = idx;
+    return false;
+}
+
+void IRFunc::RegAlloc::rewriteSpills(){
+    size_t nV = f.vregs.size();
+    std::vector<int32_t> slot(nV, 0);
+    for(size_t v = 0; v < nV; v++){
+        if(spilled[v]){
+            f.localStackSize += 8;
+            slot[v] = f.localStackSize;
+        }
+    }
+
+    // operands that accept memory read the slot directly
+    std::vector<VRegID> slotVReg(nV, -1);
+    auto slotOperand = [&](VRegID v){
+        if(slotVReg[v] < 0){
+            slotVReg[v] = f.newVReg();
+            f.vregs[slotVReg[v]].kind = VRegKind::Slot;
+            f.vregs[slotVReg[v]].val = slot[v];
+        }
+        return slotVReg[v];
+    };
+
+    std::vector<IRInstr> pool;
+    pool.reserve(f.instrPool.size());
+    std::vector<std::pair<VRegID, VRegID>> reloaded;
+    for(auto& ins : f.instrPool){
+        const Pattern& p = patternOf(ins.cmd);
+        auto isSpilled = [&](VRegID v){
+            return v >= 0 && (size_t)v < nV && spilled[v];
+        };
+        auto nonReg = [&](VRegID v){
+            return v >= 0 && f.vregs[v].kind != VRegKind::Temp;
+        };
+
+        // reload the remaining spilled sources into fresh short-lived vregs
+        reloaded.clear();
+        auto reload = [&](VRegID& v){
+            for(auto& [from, to] : reloaded){
+                if(from == v){
+                    v = to;
+                    return;
+                }
+            }
+            VRegID nv = f.newVReg();
+            IRInstr reload;
+            reload.cmd = IRCmd::RELOAD;
+            reload.t = nv;
+            reload.imm = slot[v];
+            pool.push_back(reload);
+            reloaded.push_back({v, nv});
+            v = nv;
+        };
+
+        if(isSpilled(ins.s2)){
+            // s1 may already be a slot from an earlier round
+            if((p.s2 & OpMem) && !(p.single && nonReg(ins.s1))) ins.s2 = slotOperand(ins.s2);
+            else reload(ins.s2);
+        }
+        if(isSpilled(ins.s1)){
+            if((p.s1 & OpMem) && !(p.single && nonReg(ins.s2))) ins.s1 = slotOperand(ins.s1);
+            else reload(ins.s1);
+        }
+        for(auto& a : ins.args){
+            if(!isSpilled(a)) continue;
+            if(p.args & OpMem) a = slotOperand(a);
+            else reload(a);
+        }
+
+        // store spilled targets right after the definition
+        int32_t storeSlot = 0;
+        if(ins.t >= 0 && (size_t)ins.t < nV && spilled[ins.t]){
+            storeSlot = slot[ins.t];
+            ins.t = f.newVReg();
+        }
+        pool.push_back(ins);
+        if(storeSlot != 0){
+            IRInstr store;
+            store.cmd = IRCmd::SPILL;
+            store.s1 = ins.t;
+            store.imm = storeSlot;
+            pool.push_back(store);
+        }
+    }
+    f.instrPool.swap(pool);
+    f.cfg.build(f);
+    unspillable.resize(f.vregs.size(), true);
+}
+
+PhysReg IRFunc::RegAlloc::reg(VRegID vid){
+    PhysReg r = f.getVReg(vid).assigned;
+    if(r == PhysReg::None){
+        fprintf(stderr, "No register assigned to VReg %d\n", vid);
+        exit(1);
+    }
+    return r;
+}
+
+// Applies the allocation to machine code lowered with virtual registers.
+// Spilled values were already split into reload/spill temporaries, so a
+// Slot only shows up where the instruction takes a memory operand.
+void IRFunc::RegAlloc::rewrite(MFunction& mf){
+    for(auto& ins : mf.code){
+        for(auto& o : ins.opnds){
+            if(o.kind == MOperand::Kind::VReg){
+                VReg& vr = f.getVReg(o.vreg);
+                if(vr.kind == VRegKind::Slot){
+                    o = MOperand::m(PhysReg::RBP, -(int64_t)vr.val, o.size);
+                } else {
+                    o = MOperand::r(reg(o.vreg), o.size);
+                }
+                continue;
+            }
+            if(o.kind != MOperand::Kind::Mem) continue;
+            if(o.vreg >= 0){
+                o.reg = reg(o.vreg);
+                o.vreg = -1;
+            }
+            if(o.vindex >= 0){
+                o.index = reg(o.vindex);
+                o.vindex = -1;
+            }
+        }
+    }
+}
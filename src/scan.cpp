@@ -0,0 +1,160 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TANE_X86 1
+#endif
+
+namespace {
+
+template<uint8_t Cls>
+const char* scalarSkip(const char* p){
+    while(isCharClass(*p, Cls)) p++;
+    return p;
+}
+
+const char* scalarSkipString(const char* p){
+    while(*p != '"' && *p != 0) p++;
+    return p;
+}
+
+#ifdef TANE_X86
+#define TANE_AVX2 __attribute__((target("avx2")))
+
+constexpr uintptr_t PAGE = 4096;    // smallest page size on x86
+
+// Each stop function marks with 0xff the bytes that end a run. The byte
+// range tests are unsigned: x - lo <= hi - lo, written as a min compare.
+
+inline __m128i sseInRange(__m128i x, char lo, char hi){
+    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+
+inline __m128i sseStopSpace(__m128i x){
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), sseInRange(x, '\t', '\r'));
+    return _mm_xor_si128(space, _mm_set1_epi8(-1));
+}
+
+inline __m128i sseStopDigits(__m128i x){
+    return _mm_xor_si128(sseInRange(x, '0', '9'), _mm_set1_epi8(-1));
+}
+
+inline __m128i sseStopIdent(__m128i x){
+    __m128i alpha = sseInRange(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i ident = _mm_or_si128(_mm_or_si128(alpha, sseInRange(x, '0', '9')),
+                                 _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+    return _mm_xor_si128(ident, _mm_set1_epi8(-1));
+}
+
+inline __m128i sseStopString(__m128i x){
+    return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')), _mm_cmpeq_epi8(x, _mm_setzero_si128()));
+}
+
+// Whether a load of width bytes at p stays inside p's page. Loads that
+// would not are aligned down instead, shifting out the bytes before p.
+inline bool withinPage(const char* p, uintptr_t width){
+    return (reinterpret_cast<uintptr_t>(p) & (PAGE - 1)) <= PAGE - width;
+}
+
+template<__m128i (*Stop)(__m128i)>
+const char* sseSkip(const char* p){
+    for(;;){
+        if(withinPage(p, 16)){
+            uint32_t mask = _mm_movemask_epi8(Stop(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+            if(mask) return p + __builtin_ctz(mask);
+            p += 16;
+        } else {
+            uintptr_t off = reinterpret_cast<uintptr_t>(p) & 15;
+            const char* a = p - off;
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(Stop(_mm_load_si128(reinterpret_cast<const __m128i*>(a)))) >> off;
+            if(mask) return p + __builtin_ctz(mask);
+            p = a + 16;
+        }
+    }
+}
+
+TANE_AVX2 inline __m256i avxInRange(__m256i x, char lo, char hi){
+    __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(hi - lo)), d);
+}
+
+TANE_AVX2 inline __m256i avxStopSpace(__m256i x){
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), avxInRange(x, '\t', '\r'));
+    return _mm256_xor_si256(space, _mm256_set1_epi8(-1));
+}
+
+TANE_AVX2 inline __m256i avxStopDigits(__m256i x){
+    return _mm256_xor_si256(avxInRange(x, '0', '9'), _mm256_set1_epi8(-1));
+}
+
+TANE_AVX2 inline __m256i avxStopIdent(__m256i x){
+    __m256i alpha = avxInRange(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i ident = _mm256_or_si256(_mm256_or_si256(alpha, avxInRange(x, '0', '9')),
+                                    _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+    return _mm256_xor_si256(ident, _mm256_set1_epi8(-1));
+}
+
+TANE_AVX2 inline __m256i avxStopString(__m256i x){
+    return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')),
+                           _mm256_cmpeq_epi8(x, _mm256_setzero_si256()));
+}
+
+template<__m256i (*Stop)(__m256i)>
+TANE_AVX2 const char* avxSkip(const char* p){
+    for(;;){
+        if(withinPage(p, 32)){
+            uint32_t mask = _mm256_movemask_epi8(Stop(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))));
+            if(mask) return p + __builtin_ctz(mask);
+            p += 32;
+        } else {
+            uintptr_t off = reinterpret_cast<uintptr_t>(p) & 31;
+            const char* a = p - off;
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(Stop(_mm256_load_si256(reinterpret_cast<const __m256i*>(a)))) >> off;
+            if(mask) return p + __builtin_ctz(mask);
+            p = a + 32;
+        }
+    }
+}
+#endif
+
+const SpanScanner SCALAR{"scalar", scalarSkip<CC_SPACE>, scalarSkip<CC_IDENT2>,
+                         scalarSkip<CC_DIGIT>, scalarSkipString};
+#ifdef TANE_X86
+const SpanScanner SSE2{"sse2", sseSkip<sseStopSpace>, sseSkip<sseStopIdent>,
+                       sseSkip<sseStopDigits>, sseSkip<sseStopString>};
+const SpanScanner AVX2{"avx2", avxSkip<avxStopSpace>, avxSkip<avxStopIdent>,
+                       avxSkip<avxStopDigits>, avxSkip<avxStopString>};
+#endif
+
+} // namespace
+
+bool SpanScanner::supported(Isa isa){
+    switch(isa){
+        case Isa::Scalar:
+            return true;
+#ifdef TANE_X86
+        case Isa::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case Isa::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+const SpanScanner& SpanScanner::get(Isa isa){
+#ifdef TANE_X86
+    if(isa == Isa::AVX2) return AVX2;
+    if(isa == Isa::SSE2) return SSE2;
+#endif
+    return SCALAR;
+}
+
+const SpanScanner& SpanScanner::best(){
+    static const SpanScanner& chosen = supported(Isa::AVX2) ? get(Isa::AVX2)
+                                     : supported(Isa::SSE2) ? get(Isa::SSE2)
+                                     : get(Isa::Scalar);
+    return chosen;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+/// Byte classes of the tokenizer, one table lookup per byte instead of
+/// the <cctype> calls (which also misbehave on bytes above 0x7f).
+enum CharClass : uint8_t {
+    CC_SPACE  = 1,      // ' ', \t \n \v \f \r
+    CC_DIGIT  = 2,      // 0-9
+    CC_IDENT1 = 4,      // a-z A-Z _
+    CC_IDENT2 = CC_IDENT1 | CC_DIGIT,
+};
+
+constexpr std::array<uint8_t, 256> CHAR_CLASS = []{
+    std::array<uint8_t, 256> t{};
+    for(int c = 0; c < 256; c++){
+        if(c == ' ' || (c >= '\t' && c <= '\r')) t[c] |= CC_SPACE;
+        if(c >= '0' && c <= '9') t[c] |= CC_DIGIT;
+        if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') t[c] |= CC_IDENT1;
+    }
+    return t;
+}();
+
+inline bool isCharClass(char c, uint8_t cls){
+    return CHAR_CLASS[static_cast<uint8_t>(c)] & cls;
+}
+
+/// Skips runs of bytes for the tokenizer: each function returns the first
+/// byte past the run starting at p. The input must be NUL terminated; NUL
+/// ends every run.
+/// The SSE2 and AVX2 versions compare 16 or 32 bytes at a time with
+/// unaligned loads from p. Within 16 or 32 bytes of a page end they use an
+/// aligned load ending at that boundary instead, so a load may read past
+/// the terminator but never into the next, possibly unmapped, page. best()
+/// picks the widest version the CPU supports.
+class SpanScanner{
+public:
+    enum class Isa { Scalar, SSE2, AVX2 };
+
+    const char* name;
+    const char* (*skipSpace)(const char* p);
+    const char* (*skipIdent)(const char* p);    // identifier body: CC_IDENT2
+    const char* (*skipDigits)(const char* p);
+    const char* (*skipString)(const char* p);   // up to the closing '"' or NUL
+
+    static bool supported(Isa isa);
+    static const SpanScanner& get(Isa isa);
+    static const SpanScanner& best();
+};
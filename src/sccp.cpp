@@ -0,0 +1,354 @@
+#include "opt.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+bool fitsImm(int64_t v){
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+// label a JTABLE jumps to for a known index
+int32_t tableTarget(const IRInstr& ins, int64_t index){
+    if(index >= 0 && index < (int64_t)ins.labels.size()){
+        return ins.labels[index];
+    }
+    return ins.imm;
+}
+
+} // namespace
+
+SCCP::Value SCCP::evaluate(const IRInstr& ins){
+    const Value over{Lattice::Over, 0};
+    switch(ins.cmd){
+        case IRCmd::MOV_IMM:
+            return {Lattice::Const, ins.imm};
+        case IRCmd::MOV:
+            return values[ins.s1];
+        case IRCmd::ADD:
+        case IRCmd::SUB:
+        case IRCmd::MUL:
+        case IRCmd::DIV:
+        case IRCmd::MOD:
+        case IRCmd::BIT_XOR:
+        case IRCmd::BIT_OR:
+        case IRCmd::BIT_AND:
+        case IRCmd::EQUAL:
+        case IRCmd::NEQUAL:
+        case IRCmd::LT:
+        case IRCmd::LE:
+        case IRCmd::LSHIFT:
+        case IRCmd::RSHIFT:
+            break;
+        default:
+            return over;        // loads, calls, parameters, addresses
+    }
+
+    Value a = values[ins.s1];
+    Value b = values[ins.s2];
+
+    // one known operand is enough for these
+    auto known = [](Value v, int64_t c){ return v.state == Lattice::Const && v.val == c; };
+    switch(ins.cmd){
+        case IRCmd::MUL:
+        case IRCmd::BIT_AND:
+            if(known(a, 0) || known(b, 0)) return {Lattice::Const, 0};
+            break;
+        default:
+            break;
+    }
+
+    if(a.state == Lattice::Over || b.state == Lattice::Over) return over;
+    if(a.state == Lattice::Undef || b.state == Lattice::Undef) return {};
+
+    // same 64-bit semantics as the code X86Generator emits
+    uint64_t x = a.val, y = b.val;
+    int64_t r = 0;
+    switch(ins.cmd){
+        case IRCmd::ADD: r = x + y; break;
+        case IRCmd::SUB: r = x - y; break;
+        case IRCmd::MUL: r = x * y; break;
+        case IRCmd::DIV:
+        case IRCmd::MOD:
+            // leave the trap to run time
+            if(b.val == 0 || (a.val == INT64_MIN && b.val == -1)) return over;
+            r = (ins.cmd == IRCmd::DIV) ? a.val / b.val : a.val % b.val;
+            break;
+        case IRCmd::BIT_XOR: r = x ^ y; break;
+        case IRCmd::BIT_OR: r = x | y; break;
+        case IRCmd::BIT_AND: r = x & y; break;
+        case IRCmd::EQUAL: r = a.val == b.val; break;
+        case IRCmd::NEQUAL: r = a.val != b.val; break;
+        case IRCmd::LT: r = a.val < b.val; break;
+        case IRCmd::LE: r = a.val <= b.val; break;
+        case IRCmd::LSHIFT: r = x << (y & 63); break;
+        case IRCmd::RSHIFT: r = x >> (y & 63); break;
+        default: break;
+    }
+    return {Lattice::Const, r};
+}
+
+void SCCP::run(){
+    CFG& cfg = f.cfg;
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+    size_t nB = cfg.blocks.size();
+    if(nB == 0) return;
+
+    values.assign(nV, Value{});
+
+    // instruction -> block, and vreg -> using instructions
+    std::vector<BlockIdx> blockOf(pool.size());
+    std::vector<size_t> useBegin(nV + 1, 0);
+    auto forEachSrc = [](const IRInstr& ins, auto fn){
+        if(ins.s1 >= 0) fn(ins.s1);
+        if(ins.s2 >= 0) fn(ins.s2);
+        for(auto a : ins.args) fn(a);
+    };
+    for(size_t b = 0; b < nB; b++){
+        for(size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++){
+            blockOf[i] = b;
+            forEachSrc(pool[i], [&](VRegID v){ useBegin[v + 1]++; });
+        }
+    }
+    for(size_t v = 0; v < nV; v++){
+        useBegin[v + 1] += useBegin[v];
+    }
+    std::vector<size_t> useList(useBegin[nV]);
+    {
+        std::vector<size_t> fill(useBegin.begin(), useBegin.end() - 1);
+        for(size_t i = 0; i < pool.size(); i++){
+            forEachSrc(pool[i], [&](VRegID v){ useList[fill[v]++] = i; });
+        }
+    }
+
+    std::vector<std::vector<bool>> edgeExec(nB);      // per block, per pred
+    for(size_t b = 0; b < nB; b++){
+        edgeExec[b].assign(cfg.blocks[b].preds.size(), false);
+    }
+    std::vector<bool> blockExec(nB, false);
+    std::vector<BlockIdx> flowWork;
+    std::vector<VRegID> ssaWork;
+
+    auto predIndex = [&](BlockIdx from, BlockIdx to){
+        auto& preds = cfg.blocks[to].preds;
+        return std::find(preds.begin(), preds.end(), from) - preds.begin();
+    };
+    auto markEdge = [&](BlockIdx from, BlockIdx to){
+        size_t k = predIndex(from, to);
+        if(!edgeExec[to][k]){
+            edgeExec[to][k] = true;
+            flowWork.push_back(to);
+        }
+    };
+    auto update = [&](VRegID t, Value v){
+        Value& cur = values[t];
+        // meet: Undef > Const > Over
+        Value nv = cur;
+        if(cur.state == Lattice::Undef){
+            nv = v;
+        } else if(cur.state == Lattice::Const && v.state != Lattice::Undef){
+            if(v.state == Lattice::Over || v.val != cur.val) nv = {Lattice::Over, 0};
+        }
+        if(nv.state != cur.state){
+            cur = nv;
+            ssaWork.push_back(t);
+        }
+    };
+
+    auto visit = [&](size_t i){
+        const IRInstr& ins = pool[i];
+        BlockIdx b = blockOf[i];
+        BasicBlock& bb = cfg.blocks[b];
+        switch(ins.cmd){
+            case IRCmd::PHI:
+            {
+                Value v;
+                for(size_t k = 0; k < ins.labels.size(); k++){
+                    BlockIdx p = cfg.labelBlock.at(ins.labels[k]);
+                    if(!edgeExec[b][predIndex(p, b)]) continue;
+                    Value in = values[ins.args[k]];
+                    if(in.state == Lattice::Undef) continue;
+                    if(v.state == Lattice::Undef){
+                        v = in;
+                    } else if(in.state == Lattice::Over || in.val != v.val){
+                        v = {Lattice::Over, 0};
+                    }
+                }
+                update(ins.t, v);
+                break;
+            }
+            case IRCmd::JZ:
+            case IRCmd::JNZ:
+            {
+                Value c = values[ins.s1];
+                BlockIdx target = cfg.labelBlock.at(ins.imm);
+                BlockIdx fall = (b + 1 < (BlockIdx)nB) ? b + 1 : -1;
+                if(c.state == Lattice::Undef) break;
+                if(c.state == Lattice::Over){
+                    markEdge(b, target);
+                    if(fall >= 0) markEdge(b, fall);
+                    break;
+                }
+                bool taken = (ins.cmd == IRCmd::JZ) ? c.val == 0 : c.val != 0;
+                if(taken){
+                    markEdge(b, target);
+                } else if(fall >= 0){
+                    markEdge(b, fall);
+                }
+                break;
+            }
+            case IRCmd::JMP:
+                markEdge(b, cfg.labelBlock.at(ins.imm));
+                break;
+            case IRCmd::JTABLE:
+            {
+                Value c = values[ins.s1];
+                if(c.state == Lattice::Undef) break;
+                if(c.state == Lattice::Over){
+                    for(auto label : ins.labels){
+                        markEdge(b, cfg.labelBlock.at(label));
+                    }
+                    markEdge(b, cfg.labelBlock.at(ins.imm));
+                    break;
+                }
+                markEdge(b, cfg.labelBlock.at(tableTarget(ins, c.val)));
+                break;
+            }
+            case IRCmd::RET:
+            case IRCmd::TAILCALL:
+                break;
+            default:
+                if(ins.t >= 0) update(ins.t, evaluate(ins));
+                break;
+        }
+        // blocks without a terminator, including ones holding only PHIs
+        if(i + 1 == bb.end && !isTerminator(ins.cmd) && b + 1 < (BlockIdx)nB) markEdge(b, b + 1);
+    };
+
+    blockExec[cfg.entry] = true;
+    for(size_t i = cfg.blocks[cfg.entry].begin; i < cfg.blocks[cfg.entry].end; i++){
+        visit(i);
+    }
+    while(!flowWork.empty() || !ssaWork.empty()){
+        while(!flowWork.empty()){
+            BlockIdx b = flowWork.back();
+            flowWork.pop_back();
+            BasicBlock& bb = cfg.blocks[b];
+            if(!blockExec[b]){
+                blockExec[b] = true;
+                for(size_t i = bb.begin; i < bb.end; i++){
+                    visit(i);
+                }
+            } else {
+                // a new incoming edge only changes the PHIs
+                for(size_t i = bb.begin + 1; i < bb.end && pool[i].cmd == IRCmd::PHI; i++){
+                    visit(i);
+                }
+            }
+        }
+        while(!ssaWork.empty()){
+            VRegID v = ssaWork.back();
+            ssaWork.pop_back();
+            for(size_t k = useBegin[v]; k < useBegin[v + 1]; k++){
+                if(blockExec[blockOf[useList[k]]]) visit(useList[k]);
+            }
+        }
+    }
+
+    // rewrite
+    uint64_t folded = 0, branches = 0, removed = 0;
+    auto isConst = [&](VRegID v){
+        return values[v].state == Lattice::Const && fitsImm(values[v].val);
+    };
+    auto movImm = [&](VRegID t){
+        IRInstr mov;
+        mov.cmd = IRCmd::MOV_IMM;
+        mov.t = t;
+        mov.imm = values[t].val;
+        return mov;
+    };
+    std::vector<IRInstr> out;
+    std::vector<IRInstr> foldedPhis;
+    out.reserve(pool.size());
+    for(size_t b = 0; b < nB; b++){
+        BasicBlock& bb = cfg.blocks[b];
+        if(!blockExec[b]){
+            removed += bb.end - bb.begin;
+            continue;
+        }
+        out.push_back(pool[bb.begin]);      // block label
+        size_t i = bb.begin + 1;
+        foldedPhis.clear();
+        for(; i < bb.end && pool[i].cmd == IRCmd::PHI; i++){
+            IRInstr& phi = pool[i];
+            if(isConst(phi.t)){
+                foldedPhis.push_back(movImm(phi.t));
+                folded++;
+                continue;
+            }
+            IRInstr kept = phi;
+            kept.args.clear();
+            kept.labels.clear();
+            for(size_t k = 0; k < phi.labels.size(); k++){
+                BlockIdx p = cfg.labelBlock.at(phi.labels[k]);
+                if(!edgeExec[b][predIndex(p, b)]) continue;
+                kept.args.push_back(phi.args[k]);
+                kept.labels.push_back(phi.labels[k]);
+            }
+            out.push_back(kept);
+        }
+        out.insert(out.end(), foldedPhis.begin(), foldedPhis.end());
+
+        for(; i < bb.end; i++){
+            IRInstr& ins = pool[i];
+            if((ins.cmd == IRCmd::JZ || ins.cmd == IRCmd::JNZ) && values[ins.s1].state == Lattice::Const){
+                int64_t c = values[ins.s1].val;
+                bool taken = (ins.cmd == IRCmd::JZ) ? c == 0 : c != 0;
+                branches++;
+                if(taken){
+                    IRInstr jmp;
+                    jmp.cmd = IRCmd::JMP;
+                    jmp.imm = ins.imm;
+                    out.push_back(jmp);
+                }
+                continue;
+            }
+            if(ins.cmd == IRCmd::JTABLE && values[ins.s1].state == Lattice::Const){
+                branches++;
+                IRInstr jmp;
+                jmp.cmd = IRCmd::JMP;
+                jmp.imm = tableTarget(ins, values[ins.s1].val);
+                out.push_back(jmp);
+                continue;
+            }
+            if(ins.t >= 0 && ins.cmd != IRCmd::MOV_IMM && isConst(ins.t)){
+                out.push_back(movImm(ins.t));
+                folded++;
+                continue;
+            }
+            out.push_back(ins);
+        }
+    }
+
+    // constants whose only users were folded away
+    std::vector<bool> used(nV, false);
+    for(auto& ins : out){
+        forEachSrc(ins, [&](VRegID v){ used[v] = true; });
+    }
+    std::erase_if(out, [&](const IRInstr& ins){
+        if(ins.cmd == IRCmd::MOV_IMM && !used[ins.t]){
+            removed++;
+            return true;
+        }
+        return false;
+    });
+
+    pool.swap(out);
+    cfg.build(f);
+
+    stats.add("sccp.folded", folded);
+    stats.add("sccp.branches-folded", branches);
+    stats.add("sccp.removed", removed);
+}
@@ -0,0 +1,468 @@
+#include "opt.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+// ----------------------------------------------------------------
+// Mem2Reg
+
+void Mem2Reg::run(){
+    CFG& cfg = f.cfg;
+    cfg.computeDominators();
+
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+    size_t nB = cfg.blocks.size();
+
+    // variables: frame slots, then temporaries defined more than once
+    std::unordered_map<int32_t, int32_t> slotVar;
+    std::vector<int32_t> addrVar(nV, -1);
+    std::vector<int32_t> regVar(nV, -1);
+    std::vector<int32_t> defCount(nV, 0);
+    int32_t nVars = 0;
+    for(auto& ins : pool){
+        if(ins.cmd == IRCmd::FRAME_ADDR){
+            auto it = slotVar.find(ins.imm);
+            if(it == slotVar.end()){
+                it = slotVar.emplace(ins.imm, nVars++).first;
+            }
+            addrVar[ins.t] = it->second;
+        }
+        if(ins.t >= 0) defCount[ins.t]++;
+    }
+    // a slot whose address is used for anything but LOAD/SAVE stays in memory
+    std::vector<bool> promotable(nVars, true);
+    for(auto& ins : pool){
+        auto check = [&](VRegID v){
+            if(v >= 0 && addrVar[v] >= 0) promotable[addrVar[v]] = false;
+        };
+        if(ins.cmd != IRCmd::LOAD && ins.cmd != IRCmd::SAVE) check(ins.s1);
+        check(ins.s2);
+        for(auto a : ins.args) check(a);
+    }
+    for(size_t v = 0; v < nV; v++){
+        if(defCount[v] > 1){
+            regVar[v] = nVars++;
+            promotable.push_back(true);
+        }
+    }
+    auto slotOf = [&](VRegID addr){
+        return (addr >= 0 && addrVar[addr] >= 0 && promotable[addrVar[addr]]) ? addrVar[addr] : -1;
+    };
+
+    // blocks defining each variable / reading it before any local definition
+    std::vector<std::vector<BlockIdx>> defBlocks(nVars);
+    std::vector<std::vector<BlockIdx>> useBlocks(nVars);
+    std::vector<BlockIdx> lastDef(nVars, -1);
+    for(auto b : cfg.rpo){
+        BasicBlock& bb = cfg.blocks[b];
+        auto use = [&](int32_t var){
+            if(lastDef[var] != b && (useBlocks[var].empty() || useBlocks[var].back() != b)){
+                useBlocks[var].push_back(b);
+            }
+        };
+        auto def = [&](int32_t var){
+            if(lastDef[var] != b){
+                defBlocks[var].push_back(b);
+                lastDef[var] = b;
+            }
+        };
+        for(size_t i = bb.begin; i < bb.end; i++){
+            IRInstr& ins = pool[i];
+            if(ins.cmd == IRCmd::LOAD && slotOf(ins.s1) >= 0){
+                use(slotOf(ins.s1));
+                continue;
+            }
+            if(ins.cmd == IRCmd::SAVE && slotOf(ins.s1) >= 0){
+                if(ins.s2 >= 0 && regVar[ins.s2] >= 0) use(regVar[ins.s2]);
+                def(slotOf(ins.s1));
+                continue;
+            }
+            if(ins.s1 >= 0 && regVar[ins.s1] >= 0) use(regVar[ins.s1]);
+            if(ins.s2 >= 0 && regVar[ins.s2] >= 0) use(regVar[ins.s2]);
+            for(auto a : ins.args){
+                if(regVar[a] >= 0) use(regVar[a]);
+            }
+            if(ins.t >= 0 && regVar[ins.t] >= 0) def(regVar[ins.t]);
+        }
+    }
+
+    // place PHIs on the iterated dominance frontier, only where live (pruned SSA)
+    std::vector<std::vector<PhiNode>> phis(nB);
+    std::vector<int32_t> defStamp(nB, -1);
+    std::vector<int32_t> liveStamp(nB, -1);
+    std::vector<int32_t> phiStamp(nB, -1);
+    std::vector<int32_t> workStamp(nB, -1);
+    std::vector<BlockIdx> work;
+    for(int32_t var = 0; var < nVars; var++){
+        if(!promotable[var] || useBlocks[var].empty()) continue;
+        for(auto b : defBlocks[var]){
+            defStamp[b] = var;
+        }
+        work.clear();
+        for(auto b : useBlocks[var]){
+            liveStamp[b] = var;
+            work.push_back(b);
+        }
+        while(!work.empty()){
+            BlockIdx b = work.back();
+            work.pop_back();
+            for(auto p : cfg.blocks[b].preds){
+                if(defStamp[p] != var && liveStamp[p] != var && cfg.reachable(p)){
+                    liveStamp[p] = var;
+                    work.push_back(p);
+                }
+            }
+        }
+
+        work.clear();
+        for(auto b : defBlocks[var]){
+            workStamp[b] = var;
+            work.push_back(b);
+        }
+        while(!work.empty()){
+            BlockIdx b = work.back();
+            work.pop_back();
+            for(auto d : cfg.blocks[b].df){
+                if(phiStamp[d] == var || liveStamp[d] != var) continue;
+                phiStamp[d] = var;
+                phis[d].push_back({var, f.newVReg(), std::vector<VRegID>(cfg.blocks[d].preds.size(), -1)});
+                if(workStamp[d] != var){
+                    workStamp[d] = var;
+                    work.push_back(d);
+                }
+            }
+        }
+    }
+
+    // rename along the dominator tree
+    std::vector<VRegID> cur(nVars, -1);
+    std::vector<std::pair<int32_t, VRegID>> undo;
+    std::vector<VRegID> alias(nV, -1);
+    std::vector<bool> dead(pool.size(), false);
+
+    auto value = [&](int32_t var){
+        if(cur[var] < 0){
+            if(zero < 0) zero = f.newVReg();
+            return zero;
+        }
+        return cur[var];
+    };
+    auto setVar = [&](int32_t var, VRegID v){
+        undo.push_back({var, cur[var]});
+        cur[var] = v;
+    };
+    auto resolve = [&](VRegID& s){
+        if(s < 0) return;
+        if(alias[s] >= 0){
+            s = alias[s];
+        } else if(regVar[s] >= 0){
+            s = value(regVar[s]);
+        }
+    };
+
+    auto renameBlock = [&](BlockIdx b){
+        BasicBlock& bb = cfg.blocks[b];
+        for(auto& phi : phis[b]){
+            setVar(phi.var, phi.dst);
+        }
+        for(size_t i = bb.begin; i < bb.end; i++){
+            IRInstr& ins = pool[i];
+            switch(ins.cmd){
+                case IRCmd::FRAME_ADDR:
+                    if(slotOf(ins.t) >= 0){
+                        dead[i] = true;
+                        continue;
+                    }
+                    break;
+                case IRCmd::LOAD:
+                    if(slotOf(ins.s1) >= 0){
+                        alias[ins.t] = value(slotOf(ins.s1));
+                        dead[i] = true;
+                        continue;
+                    }
+                    break;
+                case IRCmd::SAVE:
+                    if(slotOf(ins.s1) >= 0){
+                        resolve(ins.s2);
+                        setVar(slotOf(ins.s1), ins.s2);
+                        dead[i] = true;
+                        continue;
+                    }
+                    break;
+                case IRCmd::MOV:
+                    resolve(ins.s1);
+                    if(regVar[ins.t] >= 0){
+                        setVar(regVar[ins.t], ins.s1);
+                    } else {
+                        alias[ins.t] = ins.s1;
+                    }
+                    dead[i] = true;
+                    continue;
+                default:
+                    break;
+            }
+            resolve(ins.s1);
+            resolve(ins.s2);
+            for(auto& a : ins.args){
+                resolve(a);
+            }
+            if(ins.t >= 0 && regVar[ins.t] >= 0){
+                VRegID nt = f.newVReg();
+                setVar(regVar[ins.t], nt);
+                ins.t = nt;
+            }
+        }
+        for(auto s : bb.succs){
+            auto& preds = cfg.blocks[s].preds;
+            size_t k = std::find(preds.begin(), preds.end(), b) - preds.begin();
+            for(auto& phi : phis[s]){
+                phi.in[k] = value(phi.var);
+            }
+        }
+    };
+
+    struct Frame{ BlockIdx b; size_t mark; size_t child; };
+    std::vector<Frame> stack;
+    stack.push_back({0, undo.size(), 0});
+    renameBlock(0);
+    while(!stack.empty()){
+        Frame& fr = stack.back();
+        auto& children = cfg.blocks[fr.b].domChildren;
+        if(fr.child < children.size()){
+            BlockIdx c = children[fr.child++];
+            stack.push_back({c, undo.size(), 0});
+            renameBlock(c);
+        } else {
+            while(undo.size() > fr.mark){
+                cur[undo.back().first] = undo.back().second;
+                undo.pop_back();
+            }
+            stack.pop_back();
+        }
+    }
+
+    // reassemble reachable blocks in their original order
+    std::vector<IRInstr> out;
+    out.reserve(pool.size());
+    for(size_t b = 0; b < nB; b++){
+        BasicBlock& bb = cfg.blocks[b];
+        if(!cfg.reachable(b)) continue;
+        out.push_back(pool[bb.begin]);     // block label
+        if(b == 0 && zero >= 0){
+            IRInstr imm;
+            imm.cmd = IRCmd::MOV_IMM;
+            imm.t = zero;
+            imm.imm = 0;
+            out.push_back(imm);
+        }
+        for(auto& phi : phis[b]){
+            IRInstr ins;
+            ins.cmd = IRCmd::PHI;
+            ins.t = phi.dst;
+            for(size_t k = 0; k < bb.preds.size(); k++){
+                if(!cfg.reachable(bb.preds[k])) continue;
+                ins.args.push_back(phi.in[k]);
+                ins.labels.push_back(cfg.blocks[bb.preds[k]].label);
+            }
+            out.push_back(ins);
+        }
+        for(size_t i = bb.begin + 1; i < bb.end; i++){
+            if(!dead[i]) out.push_back(pool[i]);
+        }
+    }
+    pool.swap(out);
+    cfg.build(f);
+
+    // frame slots that are still addressed
+    uint32_t frame = 0;
+    for(auto& ins : pool){
+        if(ins.cmd == IRCmd::FRAME_ADDR && (uint32_t)ins.imm > frame){
+            frame = ins.imm;
+        }
+    }
+    f.localStackSize = frame;
+}
+
+// ----------------------------------------------------------------
+// PhiElim
+
+void PhiElim::run(){
+    bool hasPhi = false;
+    for(auto& ins : f.instrPool){
+        if(ins.cmd == IRCmd::PHI){
+            hasPhi = true;
+            break;
+        }
+    }
+    if(!hasPhi) return;
+
+    CFG& cfg = f.cfg;
+    auto& pool = f.instrPool;
+    size_t nB = cfg.blocks.size();
+
+    // copies needed on the edge pred -> b
+    auto edgeCopies = [&](BlockIdx pred, BlockIdx b){
+        std::vector<std::pair<VRegID, VRegID>> copies;
+        BasicBlock& bb = cfg.blocks[b];
+        int32_t label = cfg.blocks[pred].label;
+        for(size_t i = bb.begin + 1; i < bb.end && pool[i].cmd == IRCmd::PHI; i++){
+            IRInstr& phi = pool[i];
+            for(size_t k = 0; k < phi.labels.size(); k++){
+                if(phi.labels[k] == label){
+                    copies.push_back({phi.t, phi.args[k]});
+                    break;
+                }
+            }
+        }
+        return copies;
+    };
+    auto hasPhis = [&](BlockIdx b){
+        BasicBlock& bb = cfg.blocks[b];
+        return bb.begin + 1 < bb.end && pool[bb.begin + 1].cmd == IRCmd::PHI;
+    };
+
+    std::vector<IRInstr> out;
+    std::vector<IRInstr> tail;      // split blocks for branch edges, placed after the function body
+    out.reserve(pool.size());
+    for(size_t b = 0; b < nB; b++){
+        BasicBlock& bb = cfg.blocks[b];
+        IRInstr last = pool[bb.end - 1];
+        size_t bodyEnd = isTerminator(last.cmd) ? bb.end - 1 : bb.end;
+        for(size_t i = bb.begin; i < bodyEnd; i++){
+            if(pool[i].cmd != IRCmd::PHI) out.push_back(pool[i]);
+        }
+        BlockIdx fall = (b + 1 < nB) ? (BlockIdx)(b + 1) : -1;
+
+        switch(last.cmd){
+            case IRCmd::RET:
+            case IRCmd::TAILCALL:
+                out.push_back(last);
+                break;
+            case IRCmd::JMP:
+            {
+                BlockIdx target = cfg.labelBlock.at(last.imm);
+                if(hasPhis(target)) emitCopies(edgeCopies(b, target), out);
+                out.push_back(last);
+                break;
+            }
+            case IRCmd::JTABLE:
+            {
+                // one split block per successor with phis, shared by its entries
+                std::unordered_map<BlockIdx, int32_t> split;
+                auto retarget = [&](int32_t& label){
+                    BlockIdx target = cfg.labelBlock.at(label);
+                    if(!hasPhis(target)) return;
+                    auto it = split.find(target);
+                    if(it == split.end()){
+                        IRInstr lbl;
+                        lbl.cmd = IRCmd::LLABEL;
+                        lbl.imm = f.newLabel();
+                        tail.push_back(lbl);
+                        emitCopies(edgeCopies(b, target), tail);
+                        IRInstr jmp;
+                        jmp.cmd = IRCmd::JMP;
+                        jmp.imm = label;
+                        tail.push_back(jmp);
+                        it = split.emplace(target, lbl.imm).first;
+                    }
+                    label = it->second;
+                };
+                for(auto& label : last.labels){
+                    retarget(label);
+                }
+                retarget(last.imm);
+                out.push_back(last);
+                break;
+            }
+            case IRCmd::JZ:
+            case IRCmd::JNZ:
+            {
+                // both edges leave a block with two successors: split them
+                BlockIdx target = cfg.labelBlock.at(last.imm);
+                if(target == fall){
+                    if(hasPhis(fall)){
+                        last.imm = f.newLabel();
+                        out.push_back(last);
+                        IRInstr label;
+                        label.cmd = IRCmd::LLABEL;
+                        label.imm = last.imm;
+                        out.push_back(label);
+                        emitCopies(edgeCopies(b, fall), out);
+                    } else {
+                        out.push_back(last);
+                    }
+                    break;
+                }
+                if(hasPhis(target)){
+                    IRInstr label;
+                    label.cmd = IRCmd::LLABEL;
+                    label.imm = f.newLabel();
+                    tail.push_back(label);
+                    emitCopies(edgeCopies(b, target), tail);
+                    IRInstr jmp;
+                    jmp.cmd = IRCmd::JMP;
+                    jmp.imm = last.imm;
+                    tail.push_back(jmp);
+                    last.imm = label.imm;
+                }
+                out.push_back(last);
+                if(fall >= 0 && hasPhis(fall)){
+                    IRInstr label;
+                    label.cmd = IRCmd::LLABEL;
+                    label.imm = f.newLabel();
+                    out.push_back(label);
+                    emitCopies(edgeCopies(b, fall), out);
+                }
+                break;
+            }
+            default:
+                if(fall >= 0 && hasPhis(fall)) emitCopies(edgeCopies(b, fall), out);
+                break;
+        }
+    }
+    out.insert(out.end(), tail.begin(), tail.end());
+    pool.swap(out);
+    cfg.build(f);
+}
+
+// Sequentialise a parallel copy; a cycle is broken with one temporary.
+void PhiElim::emitCopies(std::vector<std::pair<VRegID, VRegID>> copies, std::vector<IRInstr>& out){
+    auto mov = [&](VRegID dst, VRegID src){
+        IRInstr ins;
+        ins.cmd = IRCmd::MOV;
+        ins.t = dst;
+        ins.s1 = src;
+        out.push_back(ins);
+    };
+    std::erase_if(copies, [](auto& c){ return c.first == c.second; });
+
+    while(!copies.empty()){
+        bool progress = false;
+        for(size_t i = 0; i < copies.size(); i++){
+            VRegID dst = copies[i].first;
+            bool read = false;
+            for(auto& c : copies){
+                if(c.second == dst){
+                    read = true;
+                    break;
+                }
+            }
+            if(!read){
+                mov(dst, copies[i].second);
+                copies.erase(copies.begin() + i);
+                progress = true;
+                break;
+            }
+        }
+        if(progress) continue;
+
+        // every destination is still needed as a source: save one aside
+        VRegID dst = copies[0].first;
+        VRegID tmp = f.newVReg();
+        mov(tmp, dst);
+        for(auto& c : copies){
+            if(c.second == dst) c.second = tmp;
+        }
+    }
+}
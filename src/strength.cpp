@@ -0,0 +1,192 @@
+#include "opt.h"
+
+#include <map>
+
+namespace {
+
+// A header PHI stepping by a constant on every trip around the loop:
+// i = PHI [init, entry] [next, latch] with next = i + step.
+struct Induction{
+    VRegID init;
+    size_t nextAt;          // index of the instruction defining next
+    int64_t step;
+};
+
+IRInstr makeInstr(IRCmd cmd, VRegID t, VRegID s1, VRegID s2){
+    IRInstr ins;
+    ins.cmd = cmd;
+    ins.t = t;
+    ins.s1 = s1;
+    ins.s2 = s2;
+    return ins;
+}
+
+} // namespace
+
+void StrengthReduce::run(){
+    CFG& cfg = f.cfg;
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+    if(cfg.blocks.empty()) return;
+    cfg.computeDominators();
+    std::vector<Loop> loops = cfg.findLoops();
+
+    std::vector<int32_t> defs(nV, 0);
+    std::vector<size_t> defAt(nV, 0);
+    std::vector<BlockIdx> blockOf(pool.size(), -1);
+    for(size_t b = 0; b < cfg.blocks.size(); b++){
+        for(size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++){
+            blockOf[i] = b;
+            if(pool[i].t < 0) continue;
+            defs[pool[i].t]++;
+            defAt[pool[i].t] = i;
+        }
+    }
+    auto constOf = [&](VRegID v, int64_t& val){
+        if(defs[v] != 1 || pool[defAt[v]].cmd != IRCmd::MOV_IMM) return false;
+        val = pool[defAt[v]].imm;
+        return true;
+    };
+
+    // new instructions go in front of / behind existing ones
+    std::vector<std::vector<IRInstr>> before(pool.size()), after(pool.size());
+    std::vector<bool> dead(pool.size(), false);
+    std::vector<VRegID> repl(nV, -1);
+    uint64_t reduced = 0;
+
+    // loopOf[b] is the index of the loop whose body was last marked
+    std::vector<int32_t> loopOf(cfg.blocks.size(), -1);
+    for(size_t li = 0; li < loops.size(); li++){
+        const Loop& l = loops[li];
+        for(auto b : l.blocks){
+            loopOf[b] = li;
+        }
+        auto inLoop = [&](BlockIdx b){ return loopOf[b] == (int32_t)li; };
+        BlockIdx h = l.header;
+        if(l.latches.size() != 1) continue;
+        BlockIdx latch = l.latches[0];
+        BlockIdx pre = -1;
+        int32_t outside = 0;
+        for(auto p : cfg.blocks[h].preds){
+            if(inLoop(p) || !cfg.reachable(p)) continue;
+            pre = p;
+            outside++;
+        }
+        if(outside != 1 || cfg.blocks[pre].succs.size() != 1) continue;
+        int32_t preLabel = cfg.blocks[pre].label;
+        int32_t latchLabel = cfg.blocks[latch].label;
+        if(preLabel < 0 || latchLabel < 0) continue;
+
+        std::map<VRegID, Induction> ivs;
+        for(size_t i = cfg.blocks[h].begin; i < cfg.blocks[h].end; i++){
+            const IRInstr& phi = pool[i];
+            if(phi.cmd != IRCmd::PHI || phi.args.size() != 2 || defs[phi.t] != 1) continue;
+            size_t fromPre = (phi.labels[0] == preLabel) ? 0 : 1;
+            if(phi.labels[fromPre] != preLabel || phi.labels[1 - fromPre] != latchLabel) continue;
+            VRegID next = phi.args[1 - fromPre];
+            if(defs[next] != 1) continue;
+            const IRInstr& inc = pool[defAt[next]];
+            int64_t step;
+            if(inc.cmd == IRCmd::ADD && inc.s1 == phi.t && constOf(inc.s2, step)){
+            } else if(inc.cmd == IRCmd::ADD && inc.s2 == phi.t && constOf(inc.s1, step)){
+            } else if(inc.cmd == IRCmd::SUB && inc.s1 == phi.t && constOf(inc.s2, step)){
+                step = -step;
+            } else {
+                continue;
+            }
+            ivs[phi.t] = {phi.args[fromPre], defAt[next], step};
+        }
+        if(ivs.empty()) continue;
+
+        size_t preEnd = cfg.blocks[pre].end - 1;
+        auto& preCode = isTerminator(pool[preEnd].cmd) ? before[preEnd] : after[preEnd];
+        auto invariant = [&](VRegID v){
+            return defs[v] == 1 && !inLoop(blockOf[defAt[v]]);
+        };
+
+        // i * k becomes a second induction variable j = i * k stepping by
+        // step * k, for k constant or defined outside the loop
+        std::map<std::pair<VRegID, VRegID>, VRegID> made;
+        for(auto b : l.blocks){
+            for(size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++){
+                IRInstr& mul = pool[i];
+                if(mul.cmd != IRCmd::MUL || dead[i] || defs[mul.t] != 1) continue;
+                VRegID iv = mul.s1, k = mul.s2;
+                if(!ivs.count(iv)) std::swap(iv, k);
+                if(!ivs.count(iv) || iv == k) continue;
+                int64_t kval = 0;
+                bool isConst = constOf(k, kval);
+                if(!isConst && !invariant(k)) continue;
+
+                auto key = std::make_pair(iv, k);
+                auto it = made.find(key);
+                if(it == made.end()){
+                    const Induction& ind = ivs[iv];
+                    VRegID factor = k;
+                    VRegID stride = f.newVReg();
+                    if(isConst){
+                        int64_t s = ind.step * kval;
+                        if(s != (int32_t)s) continue;
+                        factor = f.newVReg();
+                        IRInstr c = makeInstr(IRCmd::MOV_IMM, factor, -1, -1);
+                        c.imm = kval;
+                        preCode.push_back(c);
+                        c = makeInstr(IRCmd::MOV_IMM, stride, -1, -1);
+                        c.imm = s;
+                        preCode.push_back(c);
+                    } else {
+                        VRegID stepReg = f.newVReg();
+                        IRInstr c = makeInstr(IRCmd::MOV_IMM, stepReg, -1, -1);
+                        c.imm = ind.step;
+                        preCode.push_back(c);
+                        preCode.push_back(makeInstr(IRCmd::MUL, stride, stepReg, factor));
+                    }
+                    VRegID start = f.newVReg();
+                    VRegID cur = f.newVReg();
+                    VRegID next = f.newVReg();
+                    int64_t initVal;
+                    if(isConst && constOf(ind.init, initVal) && initVal * kval == (int32_t)(initVal * kval)){
+                        IRInstr c = makeInstr(IRCmd::MOV_IMM, start, -1, -1);
+                        c.imm = initVal * kval;
+                        preCode.push_back(c);
+                    } else {
+                        preCode.push_back(makeInstr(IRCmd::MUL, start, ind.init, factor));
+                    }
+
+                    IRInstr phi = makeInstr(IRCmd::PHI, cur, -1, -1);
+                    phi.args = {start, next};
+                    phi.labels = {preLabel, latchLabel};
+                    after[cfg.blocks[h].begin].push_back(phi);
+                    after[ind.nextAt].push_back(makeInstr(IRCmd::ADD, next, cur, stride));
+                    it = made.emplace(key, cur).first;
+                }
+                repl.resize(f.vregs.size(), -1);
+                repl[mul.t] = it->second;
+                dead[i] = true;
+                reduced++;
+            }
+        }
+    }
+
+    stats.add("strength.iv", reduced);
+    if(reduced == 0) return;
+
+    auto rename = [&](VRegID& v){
+        if(v >= 0 && v < (VRegID)repl.size() && repl[v] >= 0) v = repl[v];
+    };
+    std::vector<IRInstr> out;
+    out.reserve(pool.size());
+    auto emit = [&](IRInstr ins){
+        rename(ins.s1);
+        rename(ins.s2);
+        for(auto& a : ins.args) rename(a);
+        out.push_back(std::move(ins));
+    };
+    for(size_t i = 0; i < pool.size(); i++){
+        for(auto& ins : before[i]) emit(std::move(ins));
+        if(!dead[i]) emit(std::move(pool[i]));
+        for(auto& ins : after[i]) emit(std::move(ins));
+    }
+    pool.swap(out);
+    cfg.build(f);
+}
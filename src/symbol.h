@@ -34,6 +34,7 @@ public:
     SymbolFlags flags = SymbolFlags::None;
     uint32_t stackOffset = 0;
     std::vector<SymbolIdx> params;
+    std::vector<int32_t> inlineIR;      // IRFunc::encode() of an imported body, if exported
     
     // ヘルパーメソッド
     bool isMut() const { return hasFlag(flags, SymbolFlags::Mutable); }
@@ -42,7 +42,8 @@ std::vector<Symbol> TnlibLoader::loadTnlib(const std::string& moduleName)
     std::vector<Symbol> symbols;
 
     ts.expect(TokenKind::Tnlib);
-    ts.expect(TokenKind::Num);  // version number
+    int32_t version = ts.expectNum();
+    bool warned = false;
 
     ts.expect(TokenKind::Module);
     ts.expectIdent();
@@ -53,18 +54,16 @@ std::vector<Symbol> TnlibLoader::loadTnlib(const std::string& moduleName)
         ts.expect(TokenKind::LParen);
 
         Symbol fnSym;
-        Token fnToken = ts.getToken(fnIdent);
-        fnSym.name = std::string(fnToken.pos, fnToken.len);
+        fnSym.name = std::string(ts.text(fnIdent));
         fnSym.kind = SymbolKind::Function;
         fnSym.setMut(false);
 
         if(!ts.peekKind(TokenKind::RParen)){
             do {
                 TokenIdx paramIdent = ts.expectIdent();
-                Token pToken = ts.getToken(paramIdent);
 
                 Symbol paramSym;
-                paramSym.name = std::string(pToken.pos, pToken.len);
+                paramSym.name = std::string(ts.text(paramIdent));
                 paramSym.kind = SymbolKind::Variable;
                 paramSym.setMut(false);
 
@@ -74,6 +73,32 @@ std::vector<Symbol> TnlibLoader::loadTnlib(const std::string& moduleName)
             } while(ts.consume(TokenKind::Comma));
         }
         ts.expect(TokenKind::RParen);
+
+        // IR of a body small enough to inline (tnlib 2)
+        if(ts.consume(TokenKind::Inline)){
+            ts.expect(TokenKind::LBrace);
+            if(version != TNLIB_VERSION){
+                // IR of another compiler version: keep the declaration only
+                if(!warned){
+                    fprintf(stderr, "Warning: %s is tnlib %d, not %d; ignoring its inline bodies\n",
+                            fullPath.c_str(), version, TNLIB_VERSION);
+                    warned = true;
+                }
+                while(!ts.consume(TokenKind::RBrace)){
+                    if(ts.peekKind(TokenKind::Eof)){
+                        fprintf(stderr, "Unterminated inline body in %s\n", fullPath.c_str());
+                        exit(1);
+                    }
+                    ts.idx++;
+                }
+            } else {
+                while(!ts.consume(TokenKind::RBrace)){
+                    bool neg = ts.consume(TokenKind::Sub);
+                    int32_t w = ts.expectNum();
+                    fnSym.inlineIR.push_back(neg ? -w : w);
+                }
+            }
+        }
         ts.expect(TokenKind::Semicolon);
 
         symbols.push_back(fnSym);
@@ -7,6 +7,10 @@
 
 using moduleSet = std::unordered_set<std::string>;
 
+// Format of the .tnlib files IRModule::outputSymbols writes. Version 2
+// added inline bodies; only bodies of this exact version are decoded.
+constexpr int32_t TNLIB_VERSION = 2;
+
 class TnlibLoader
 {
     // loaded module paths
@@ -1,6 +1,47 @@
 #include "tokenizer.h"
 
-std::map<std::string, TokenKind> Tokenizer::keyword_map = {
+#include <array>
+
+namespace {
+
+struct Keyword{
+    std::string_view name;
+    TokenKind kind;
+};
+
+/// Keyword lookup by perfect hash, built at compile time. A slot is chosen
+/// from the length and the first and last characters, so recognising an
+/// identifier costs one hash and at most one compare, with no allocation.
+/// The constructor records any collision and the tables below assert
+/// there is none; a new keyword that collides needs new multipliers.
+class KeywordTable{
+    static constexpr uint32_t SIZE = 16;
+    std::array<Keyword, SIZE> slots{};
+    bool collision = false;
+
+    static constexpr uint32_t slot(const char* s, uint32_t len){
+        return (len * 4 + (uint8_t)s[0] + (uint8_t)s[len - 1] * 7) & (SIZE - 1);
+    }
+public:
+    template<size_t N>
+    constexpr KeywordTable(const Keyword (&words)[N]){
+        for(auto& w : words){
+            Keyword& k = slots[slot(w.name.data(), w.name.size())];
+            if(!k.name.empty()) collision = true;
+            k = w;
+        }
+    }
+    constexpr bool perfect() const { return !collision; }
+
+    TokenKind find(const char* s, uint32_t len) const{
+        const Keyword& k = slots[slot(s, len)];
+        if(k.name == std::string_view(s, len)) return k.kind;
+        // Not a keyword, so it must be an identifier
+        return TokenKind::Ident;
+    }
+};
+
+constexpr Keyword KEYWORDS[] = {
     {"return", TokenKind::Return},
     {"let", TokenKind::Let},
     {"mut", TokenKind::Mut},
@@ -13,16 +54,24 @@ std::map<std::string, TokenKind> Tokenizer::keyword_map = {
     {"pub", TokenKind::Pub},
 };
 
-std::map<std::string, TokenKind> Tokenizer::tnlib_keyword_map = {
+constexpr Keyword TNLIB_KEYWORDS[] = {
     {"tnlib", TokenKind::Tnlib},
     {"module", TokenKind::Module},
     {"fn", TokenKind::Fn},
     {"end", TokenKind::End},
-};  
+    {"inline", TokenKind::Inline},
+};
+
+constexpr KeywordTable keyword_table(KEYWORDS);
+constexpr KeywordTable tnlib_keyword_table(TNLIB_KEYWORDS);
+static_assert(keyword_table.perfect() && tnlib_keyword_table.perfect());
+
+} // namespace
 
 Tokenizer::TokenStream& Tokenizer::scan(char* p){
     TokenStream& ts = *(new TokenStream());
     ts.clear();
+    ts.src = p;
 
     bool continue_flg = true;
 
@@ -141,33 +190,29 @@ Tokenizer::TokenStream& Tokenizer::scan(char* p){
             case '"':
                 {
                     char* q = p + 1;
-                    p++;
-                    while(*p != '"' && *p != 0){
-                        p++;
-                    }
+                    p = const_cast<char*>(spans->skipString(q));
                     if(*p == 0){
                         fprintf(stderr, "Unterminated string literal: %s\n", q - 1);
                         exit(1);
                     }
                     ts.addToken(TokenKind::StringLiteral, q);
                     ts.getTop().len = p - q;
-                    ts.getTop().str = std::string(q, p - q);
                     p++; // skip closing "
                 }
                 break;
             default:
-                if(isdigit(c)){
+                if(isCharClass(c, CC_DIGIT)){
                     char* q = p;
-                    int32_t val = strtol(p, &p, 10);
+                    p = const_cast<char*>(spans->skipDigits(p));
 
                     ts.addToken(TokenKind::Num, q);
-                    ts.getTop().val = val;
-                } else if(isspace(c)){
-                    p++;
+                    ts.getTop().len = p - q;
+                    ts.getTop().val = parseNum(q, p);
+                } else if(isCharClass(c, CC_SPACE)){
+                    p = const_cast<char*>(spans->skipSpace(p));
                 } else if(is_ident1(c)){
                     char* q = p;
-                    p++;
-                    while(is_ident2(*p)) p++;
+                    p = const_cast<char*>(spans->skipIdent(p + 1));
                     ts.addToken(checkKeyword(q, p - q), q);
                     ts.getTop().len = p - q;
                 } else {
@@ -181,39 +226,34 @@ Tokenizer::TokenStream& Tokenizer::scan(char* p){
 }
 
 TokenKind Tokenizer::checkKeyword(char* start, uint32_t len){
-
-    if(for_tnlib){
-        if(tnlib_keyword_map.find(std::string(start, len)) != tnlib_keyword_map.end()){
-            return tnlib_keyword_map[std::string(start, len)];
-        }
-
-        // Not a keyword, so it must be an identifier
-        return TokenKind::Ident;
-    } else {
-        if(keyword_map.find(std::string(start, len)) != keyword_map.end()){
-            return keyword_map[std::string(start, len)];
-        }
-        // Not a keyword, so it must be an identifier
-        return TokenKind::Ident;
-    }
+    return for_tnlib ? tnlib_keyword_table.find(start, len) : keyword_table.find(start, len);
 }
 
 bool Tokenizer::is_ident1(char c){
-    return isalpha(c) || c == '_';
+    return isCharClass(c, CC_IDENT1);
 }
 
 bool Tokenizer::is_ident2(char c){
-    return is_ident1(c) || isdigit(c);
+    return isCharClass(c, CC_IDENT2);
+}
+
+// Value of the digits in [p, end), saturating like strtol before it is
+// narrowed to 32 bits.
+int32_t Tokenizer::parseNum(const char* p, const char* end){
+    int64_t val = 0;
+    for(; p < end; p++){
+        int32_t d = *p - '0';
+        if(val > (INT64_MAX - d) / 10){
+            return (int32_t)INT64_MAX;
+        }
+        val = val * 10 + d;
+    }
+    return (int32_t)val;
 }
 
 // TokenStream member functions
 void Tokenizer::TokenStream::addToken(TokenKind kind, char* pos){
-    Token t;
-    t.kind = kind;
-    t.pos = pos;
-    t.len = 1;
-    t.val = 0;
-    tokens.push_back(t);
+    tokens.push_back({kind, static_cast<uint32_t>(pos - src), 1, 0});
 }
 
 bool Tokenizer::TokenStream::consume(TokenKind kind){
@@ -1,11 +1,12 @@
 #pragma once
 #include <cstdint>
 #include <string>
-#include <map>
+#include <string_view>
 #include <vector>
 #include <optional>
 
 #include "common_type.h"
+#include "scan.h"
 
 enum class TokenKind {
     Num,
@@ -49,30 +50,38 @@ enum class TokenKind {
     Tnlib,
     Module,
     End,         // "end"
+    Inline,      // "inline"
     // =========== end of tnlib ===========
     Eof,
 };
 
+/// A token refers back into the source buffer instead of owning its text:
+/// offset and len locate it, TokenStream::text() views it.
 struct Token{
     TokenKind kind;
+    uint32_t offset;
+    uint32_t len;
     int32_t val;
-    char* pos;
-    int32_t len;
-    std::string str;
 };
+static_assert(sizeof(Token) == 16);
 
 class Tokenizer {
 public:
     class TokenStream {
         friend class Tokenizer;
         std::vector<Token> tokens;
+        const char* src = nullptr;      // buffer the tokens point into
         void clear() { tokens.clear(); }
         void addToken(const Token& token) { tokens.push_back(token); }
         void addToken(TokenKind kind, char* pos);
         Token& getTop() { return tokens.back(); }
     public:
         TokenIdx idx;
-        Token getToken(TokenIdx idx) { return tokens[idx]; }
+        const Token& getToken(TokenIdx idx) const { return tokens[idx]; }
+        std::string_view text(TokenIdx idx) const {
+            return std::string_view(src + tokens[idx].offset, tokens[idx].len);
+        }
+        size_t size() const { return tokens.size(); }
         void reset() { idx = 0; }
         bool consume(TokenKind kind);
         void expect(TokenKind kind);
@@ -85,14 +94,13 @@ public:
     TokenStream& scan(char* p);
     Tokenizer(bool for_tnlib = false) : for_tnlib(for_tnlib) {}
     bool for_tnlib;
+    const SpanScanner* spans = &SpanScanner::best();
     void printTokens(TokenStream& ts);
 private:
-    static std::map<std::string, TokenKind> keyword_map;
-    static std::map<std::string, TokenKind> tnlib_keyword_map;
     //TokenStream ts;
     TokenKind checkKeyword(char* start, uint32_t len);
-    TokenKind checkKeywordTnlib(char* start, uint32_t len);
     bool is_ident1(char c);
     bool is_ident2(char c);
+    static int32_t parseNum(const char* p, const char* end);
     void printTokenKind(TokenKind kind);
 };
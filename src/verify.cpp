@@ -0,0 +1,101 @@
+#include "opt.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_set>
+
+void IRVerifier::fail(const std::string& msg) const{
+    fprintf(stderr, "IR verification failed after %s in %s: %s\n", after, f.fname.c_str(), msg.c_str());
+    exit(1);
+}
+
+void IRVerifier::run(){
+    auto& pool = f.instrPool;
+    size_t nV = f.vregs.size();
+    auto where = [&](size_t i){
+        return "instruction " + std::to_string(i) + " (cmd " + std::to_string((int)pool[i].cmd) + ")";
+    };
+
+    // operands and labels
+    std::unordered_set<int32_t> labels;
+    for(size_t i = 0; i < pool.size(); i++){
+        if(pool[i].cmd == IRCmd::LLABEL && !labels.insert(pool[i].imm).second){
+            fail("label " + std::to_string(pool[i].imm) + " defined twice");
+        }
+    }
+    std::vector<int32_t> defs(nV, 0);
+    for(size_t i = 0; i < pool.size(); i++){
+        const IRInstr& ins = pool[i];
+        for(VRegID v : {ins.s1, ins.s2, ins.t}){
+            if(v >= (VRegID)nV) fail(where(i) + " uses unknown vreg " + std::to_string(v));
+        }
+        for(auto a : ins.args){
+            if(a < 0 || a >= (VRegID)nV) fail(where(i) + " uses unknown vreg " + std::to_string(a));
+        }
+        if(ins.t >= 0) defs[ins.t]++;
+        if(hasLabelImm(ins.cmd) && ins.cmd != IRCmd::LLABEL && !labels.count(ins.imm)){
+            fail(where(i) + " jumps to missing label " + std::to_string(ins.imm));
+        }
+        for(auto l : ins.labels){
+            if(!labels.count(l)) fail(where(i) + " names missing label " + std::to_string(l));
+        }
+        if(ins.cmd == IRCmd::PHI && ins.args.size() != ins.labels.size()){
+            fail(where(i) + " has " + std::to_string(ins.args.size()) + " inputs for "
+                 + std::to_string(ins.labels.size()) + " labels");
+        }
+    }
+    // the pass must have rebuilt the CFG after changing the instructions
+    CFG cfg;
+    cfg.build(f);
+    if(cfg.blocks.size() != f.cfg.blocks.size()) fail("stale CFG");
+    for(size_t b = 0; b < cfg.blocks.size(); b++){
+        const BasicBlock& x = cfg.blocks[b];
+        const BasicBlock& y = f.cfg.blocks[b];
+        if(x.begin != y.begin || x.end != y.end || x.succs != y.succs) fail("stale CFG");
+    }
+    if(pool.empty()) return;
+    cfg.computeDominators();
+
+    std::vector<BlockIdx> blockOf(pool.size());
+    std::vector<size_t> defAt(nV, 0);
+    for(size_t b = 0; b < cfg.blocks.size(); b++){
+        bool phis = true;
+        for(size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++){
+            blockOf[i] = b;
+            if(pool[i].t >= 0) defAt[pool[i].t] = i;
+            if(pool[i].cmd == IRCmd::PHI){
+                if(!phis) fail(where(i) + " is a PHI after other instructions");
+                for(auto l : pool[i].labels){
+                    auto& preds = cfg.blocks[b].preds;
+                    if(std::find(preds.begin(), preds.end(), cfg.labelBlock.at(l)) == preds.end()){
+                        fail(where(i) + " has an input from non-predecessor label " + std::to_string(l));
+                    }
+                }
+            } else if(pool[i].cmd != IRCmd::LLABEL){
+                phis = false;
+            }
+        }
+    }
+
+    // definitions reach their uses
+    auto check = [&](size_t i, VRegID v, BlockIdx useBlock, bool atEnd){
+        if(defs[v] == 0) fail(where(i) + " reads vreg " + std::to_string(v) + " which is never defined");
+        if(defs[v] != 1 || !cfg.reachable(useBlock)) return;
+        size_t d = defAt[v];
+        BlockIdx defBlock = blockOf[d];
+        bool ok = (defBlock == useBlock) ? (atEnd || d < i) : cfg.dominates(defBlock, useBlock);
+        if(!ok) fail(where(i) + " reads vreg " + std::to_string(v) + " before its definition");
+    };
+    for(size_t i = 0; i < pool.size(); i++){
+        const IRInstr& ins = pool[i];
+        if(ins.cmd == IRCmd::PHI){
+            for(size_t k = 0; k < ins.args.size(); k++){
+                check(i, ins.args[k], cfg.labelBlock.at(ins.labels[k]), true);
+            }
+            continue;
+        }
+        if(ins.s1 >= 0) check(i, ins.s1, blockOf[i], false);
+        if(ins.s2 >= 0) check(i, ins.s2, blockOf[i], false);
+        for(auto a : ins.args) check(i, a, blockOf[i], false);
+    }
+}
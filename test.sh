@@ -4,12 +4,13 @@ set -uo pipefail
 # Advanced test runner for tane
 # Usage: ./test.sh
 # Each test: 
-# 1. Calls build/tane "code" to generate out.s
+# 1. Calls build/tane [flags] "code" to generate out.s
 # 2. Compiles out.s to executable
 # 3. Runs executable and shows result
 
 BIN="build/tane"
 ASM_FILE="out.s"
+OBJ_FILE="out.o"
 TEST_EXE="test_program"
 
 if [[ ! -x "$BIN" ]]; then
@@ -22,64 +23,96 @@ fail=0
 
 echo "Running assembly compilation tests..."
 
+# Runs a command and counts a pass when it exits with the expected status,
+# or with any status when none is given
+check_exit() {
+  local expected="$1"
+  shift
+
+  echo "> $*"
+  "$@" > /dev/null
+  local exit_code=$?
+  if [[ -z "$expected" || "$exit_code" == "$expected" ]]; then
+    echo "✅ Expected result: ${expected:-any}, Got: $exit_code"
+    ((pass++))
+  else
+    echo "❌ Expected result: $expected, Got: $exit_code"
+    ((fail++))
+  fi
+}
+
+# Reports a step that failed before the program could run
+fail_step() {
+  echo "❌ $1"
+  ((fail++))
+}
+
 run_test() {
   local code="$1"
   local expected="${2:-}"
-  
+  local flags="${3:-}"
+
   echo "----------------------------------------"
   echo "Testing: $code"
-  
-  # Step 1: Generate assembly
-  echo "> $BIN -c \"$code\""
-  if ! $BIN -c "$code" 2>/dev/null; then
-    echo "❌ Failed to generate assembly"
-    ((fail++))
+  echo "> $BIN $flags -c \"$code\""
+  if ! $BIN $flags -c "$code" 2>/dev/null || [[ ! -f "$ASM_FILE" ]]; then
+    fail_step "Failed to generate assembly"
     return
   fi
-  
-  # Step 2: Check if out.s was generated
-  if [[ ! -f "$ASM_FILE" ]]; then
-    echo "❌ Assembly file $ASM_FILE was not generated"
-    ((fail++))
+  if ! gcc -o "$TEST_EXE" "$ASM_FILE" 2>/dev/null; then
+    fail_step "Failed to compile assembly"
     return
   fi
-  
-  echo "✅ Assembly generated successfully"
-  
-  # Step 3: Compile assembly to executable
-  echo "> gcc -o $TEST_EXE $ASM_FILE"
-  if ! gcc -o "$TEST_EXE" "$ASM_FILE" 2>/dev/null; then
-    echo "❌ Failed to compile assembly"
-    ((fail++))
+  check_exit "$expected" ./"$TEST_EXE"
+  rm -f "$ASM_FILE" "$TEST_EXE"
+}
+
+# Same as run_test, but tane writes an ELF object itself (-o out.o) that
+# is linked with the standard library by the system linker
+run_obj_test() {
+  local code="$1"
+  local expected="$2"
+  local flags="${3:-}"
+
+  echo "----------------------------------------"
+  echo "Testing (object): $code"
+  if ! $BIN $flags -c "$code" -o "$OBJ_FILE" 2>/dev/null; then
+    fail_step "Failed to generate object file"
     return
   fi
-  
-  echo "✅ Assembly compiled successfully"
-  
-  # Step 4: Run executable and capture exit code
-  echo "> ./$TEST_EXE"
-  ./"$TEST_EXE"
-  local exit_code=$?
-  # Handle the exit code properly (|| true was resetting $? to 0)
-  true  # Reset to prevent script exit
-  
-  echo "✅ Program executed with exit code: $exit_code"
-  
-  # Step 5: Check expected result if provided
-  if [[ -n "$expected" ]]; then
-    if [[ "$exit_code" == "$expected" ]]; then
-      echo "✅ Expected result: $expected, Got: $exit_code"
-      ((pass++))
-    else
-      echo "❌ Expected result: $expected, Got: $exit_code"
-      ((fail++))
-    fi
-  else
-    ((pass++))
+  if ! gcc -no-pie -o "$TEST_EXE" "$OBJ_FILE" -x assembler std/src/std.asm 2>/dev/null; then
+    fail_step "Failed to link object file"
+    return
   fi
-  
-  # Cleanup
-  rm -f "$ASM_FILE" "$TEST_EXE"
+  check_exit "$expected" ./"$TEST_EXE"
+  rm -f "$OBJ_FILE" "$TEST_EXE"
+}
+
+# Same again with tane linking the executable itself (--link)
+run_link_test() {
+  local code="$1"
+  local expected="$2"
+  local flags="${3:-}"
+
+  echo "----------------------------------------"
+  echo "Testing (linked): $code"
+  if ! $BIN $flags -c "$code" --link -o "$TEST_EXE" 2>/dev/null; then
+    fail_step "Failed to link executable"
+    return
+  fi
+  check_exit "$expected" ./"$TEST_EXE"
+  rm -f "$TEST_EXE"
+}
+
+# Run in-process by the JIT (--run); tane exits with main's result
+run_jit_test() {
+  local code="$1"
+  local expected="$2"
+  local flags="${3:-}"
+
+  echo "----------------------------------------"
+  echo "Testing (jit): $code"
+  check_exit "$expected" $BIN $flags -c "$code" --run
 }
 
 # Test cases
@@ -130,6 +163,74 @@ run_test "fn main(){let mut e; e = 1; while e < 10 { e = e * 2; } return e;}" "1
 run_test "fn main(){let mut f; f = 5; let mut x; x = switch f { 1 => 3, 2 => 6, 5 => 10, }; return x;}" "10"
 run_test "fn f(){return 7;} fn main(){return f();}" "7"
 run_test "fn add(a, b){return a + b;} fn main(){return add(3, 4);}" "7"
+run_test "fn main(){return 1+(2+(3+(4+(5+(6+(7+(8+(9+(10+(11+(12+(13+(14+15)))))))))))));}" "120"
+run_test "fn g(a){return a + 1;} fn main(){return g(1) + (g(2) + (g(3) + (g(4) + (g(5) + (g(6) + (g(7) + g(8)))))));}" "44"
+run_test "fn main(){let mut a; let mut b; let mut i; a = 0; b = 1; i = 0; while i < 10 { let mut t; t = a + b; a = b; b = t; i = i + 1; } return a;}" "55"
+run_test "fn f(a, b){let mut t; t = a; a = b; b = t; return a * 10 + b;} fn main(){return f(1, 2);}" "21"
+run_test "fn main(){let x; x = 2 * 3 + 4; if x == 10 { return (1 << 4) >> 2; } else { return 2; }}" "4"
+run_test "fn main(){let mut a; a = 5; return switch a { 1 => 3, 5 => 10 - 7 % 4, };}" "7"
+run_test "fn h(x){return (x << 3) - x * 2 + 100 % x;} fn main(){return h(7);}" "44"
+run_test "fn main(){let mut i; let mut n; i = 0; n = 0; while i <= 20 { if i != 8 { n = n + 1; } i = i + 2; } return n;}" "10"
+run_test "fn main(){let mut x; let mut c; x = 5; c = 0; while x { x = x - 1; c = c + 2; } return c;}" "10"
+run_test "fn f(z){if z != 0 && 2 < 10 / z { return 1; } return 2;} fn main(){return f(0) + f(3) * 10;}" "12"
+run_test "fn g(a, b){let x; x = a == 0 || 1 < b / a; return x;} fn main(){return g(0, 5) + g(5, 5) * 2 + g(2, 5) * 4;}" "5"
+run_test "fn main(){let mut i; let mut n; i = 0; n = 0; while i < 10 && (i < 3 || 6 < i) { n = n + 1; i = i + 1; } return n * 10 + i;}" "33"
+run_test "fn g(x){ let v0; v0 = x + 0; let v1; v1 = x + 1; let v2; v2 = x + 2; let v3; v3 = x + 3; let v4; v4 = x + 4; let v5; v5 = x + 5; let v6; v6 = x + 6; let v7; v7 = x + 7; let v8; v8 = x + 8; let v9; v9 = x + 9; let v10; v10 = x + 10; let v11; v11 = x + 11; let v12; v12 = x + 12; let v13; v13 = x + 13; let v14; v14 = x + 14; let v15; v15 = x + 15; return v0 * v1 + v1 * v2 + v2 * v3 + v3 * v4 + v4 * v5 + v5 * v6 + v6 * v7 + v7 * v8 + v8 * v9 + v9 * v10 + v10 * v11 + v11 * v12 + v12 * v13 + v13 * v14 + v14 * v15 + v15 * v0; } fn main(){ return g(1) % 256; }" "96"
+run_test "fn main(){let mut s; let mut i; s = 0; i = 0; while i < 8 { s = s + switch i { 1 => 10, 2 => 20, 3 => 30, 5 => 50, 6 => 60, }; i = i + 1; } return s;}" "170"
+run_test "fn main(){let mut s; let mut i; s = 0; i = 0; while i < 400 { s = s + switch i { 1 => 1, 30 => 2, 100 => 3, 170 => 4, 250 => 5, 300 => 6, 399 => 7, }; i = i + 1; } return s;}" "28"
+run_test "fn main(){let mut x; x = 2; return switch x { 1 => 1, 2 => 5, 2 => 9, 3 => 3, 4 => 4, };}" "5"
+run_test "fn get(a){return a;} fn main(){return get(4) + get(5);}" "9"
+run_test "fn id(a){return a;} fn f(a, b, c){let x; x = id(a) + id(b); return x * c + id(c);} fn main(){return f(1, 2, 3);}" "12"
+run_test "fn get(a){return a + 1;} fn sq(x){let y; y = x * x; if y < 100 { return y; } return 100;} fn main(){let mut s; let mut i; s = 0; i = 0; while i < 20 { s = s + get(i) + sq(i); i = i + 1; } return s % 256;}" "215" "-O0"
+run_test "fn get(a){return a + 1;} fn sq(x){let y; y = x * x; if y < 100 { return y; } return 100;} fn main(){let mut s; let mut i; s = 0; i = 0; while i < 20 { s = s + get(i) + sq(i); i = i + 1; } return s % 256;}" "215" "-O2"
+# calc is never linked in: both calls have to be inlined from calc.tnlib
+run_test "import calc; fn main(){ return clamp(twice(30), 0, 50) + clamp(3, 5, 9); }" "55" "-i test/src"
+# a tnlib from another format version: declarations load, inline bodies are skipped
+run_test "import future; fn main(){ return 3; }" "3" "-i test/src"
+# a hand-edited body with a CALL is not inlined: the real exit runs instead
+run_test "import stale; fn main(){ exit(5); return 1; }" "5" "-i test/src"
+run_test "fn sum(n, acc){ if n == 0 { return acc; } return sum(n - 1, acc + n); } fn main(){ return sum(10000000, 0) % 256; }" "64" "-O0"
+run_test "fn h(a, b, c){ if a == 0 { return b * 100 + c; } return h(a - 1, c, b); } fn main(){ return h(3, 1, 2) % 256; }" "201"
+run_test "fn g(a, b){return a * b + 1;} fn f(x){ let y; y = x + 1; if x < 3 { return g(y, 2);} return g(x, x); } fn main(){ return f(2) + f(5); }" "33" "-O0"
+run_test "fn fact(n){ if n <= 1 { return 1; } return n * fact(n - 1); } fn main(){ return fact(5); }" "120"
+# a helper ending in a tail call, inlined at an ordinary call site (big
+# itself is too large to inline)
+run_test "fn big(a, b){ let mut s; let mut i; s = 0; i = 0; while i < b { s = s + a * i - (a ^ i) + (i & 3); if s < 0 { s = 0 - s; } i = i + 1; } let mut t; t = s % 1000; while 50 < t { t = t - 7 * (t % 3) - 1; } return s + t * 2 + (a | b); } fn sib(x){ return big(x, 10); } fn main(){ let r; r = sib(3); return 7; }" "7"
+run_test "fn big(a, b){ let mut s; let mut i; s = 0; i = 0; while i < b { s = s + a * i - (a ^ i) + (i & 3); if s < 0 { s = 0 - s; } i = i + 1; } let mut t; t = s % 1000; while 50 < t { t = t - 7 * (t % 3) - 1; } return s + t * 2 + (a | b); } fn sib(x){ if x < 0 { return 0; } return big(x, 10); } fn main(){ return (sib(3) + sib(0 - 1) + 1) % 256; }" "205"
+run_test "fn main(){ let mut a; a = 4; a * 100; return a + 1; a = 9; return a; }" "5"
+# dead store elimination alone: the first store to a is overwritten before
+# any load and goes; in the second, b = a reads it, so it stays
+run_test "fn main(){ let mut a; a = 4; a = 9; return a; }" "9" "--passes=dce"
+run_test "fn main(){ let mut a; let b; a = 4; b = a; a = 9; return a + b; }" "13" "--passes=dce"
+# enough live values that both operands of the loop's compare are spilled,
+# in separate rounds; only one of them may stay a memory operand
+run_test "fn f(x){ let mut s; s = 0; let v0; v0 = x * 4 + 0; let v1; v1 = x * 3 + 1; let v2; v2 = x * 6 + 2; let v3; v3 = x * 3 + 3; let v4; v4 = x * 9 + 4; let v5; v5 = x * 9 + 5; let v6; v6 = x * 9 + 6; let v7; v7 = x * 8 + 7; let v8; v8 = x * 5 + 8; let v9; v9 = x * 3 + 9; let v10; v10 = x * 9 + 10; let v11; v11 = x * 2 + 11; let v12; v12 = x * 8 + 12; let v13; v13 = x * 8 + 13; let v14; v14 = x * 2 + 14; let v15; v15 = x * 9 + 15; let v16; v16 = x * 6 + 16; let v17; v17 = x * 5 + 17; let v18; v18 = x * 3 + 18; let v19; v19 = x * 7 + 19; let v20; v20 = x * 2 + 20; let v21; v21 = x * 2 + 21; let v22; v22 = x * 2 + 22; let v23; v23 = x * 2 + 23; let mut i; i = 0; while i < x { if v0 < v1 { s = s + 1; } s = s + v1; i = i + 1; } return (s + v0 + v1 + v2 + v3 + v4 + v5 + v6 + v7 + v8 + v9 + v10 + v11 + v12 + v13 + v14 + v15 + v16 + v17 + v18 + v19 + v20 + v21 + v22 + v23) % 256; } fn main(){ return f(3); }" "172"
+run_test "fn f(x){ let mut s; s = 0; let v0; v0 = x * 4 + 0; let v1; v1 = x * 3 + 1; let v2; v2 = x * 6 + 2; let v3; v3 = x * 3 + 3; let v4; v4 = x * 9 + 4; let v5; v5 = x * 9 + 5; let v6; v6 = x * 9 + 6; let v7; v7 = x * 8 + 7; let v8; v8 = x * 5 + 8; let v9; v9 = x * 3 + 9; let v10; v10 = x * 9 + 10; let v11; v11 = x * 2 + 11; let v12; v12 = x * 8 + 12; let v13; v13 = x * 8 + 13; let v14; v14 = x * 2 + 14; let v15; v15 = x * 9 + 15; let v16; v16 = x * 6 + 16; let v17; v17 = x * 5 + 17; let v18; v18 = x * 3 + 18; let v19; v19 = x * 7 + 19; let v20; v20 = x * 2 + 20; let v21; v21 = x * 2 + 21; let v22; v22 = x * 2 + 22; let v23; v23 = x * 2 + 23; let mut i; i = 0; while i < x { if v0 < v1 { s = s + 1; } s = s + v1; i = i + 1; } return (s + v0 + v1 + v2 + v3 + v4 + v5 + v6 + v7 + v8 + v9 + v10 + v11 + v12 + v13 + v14 + v15 + v16 + v17 + v18 + v19 + v20 + v21 + v22 + v23) % 256; } fn main(){ return f(3); }" "172" "-O2"
+# an unused division by zero still traps (SIGFPE)
+run_test "fn main(){ let z; z = 0; 5 / z; return 3; }" "136"
+run_test "fn f(a, b){ let x; x = a * b + a * b; let y; if a < b { y = b * a + 1; } else { y = a * b - 1; } return x + y; } fn main(){ return f(3, 4) + f(5, 2); }" "66" "--inline-threshold=0"
+run_test "fn f(a, b){ let mut i; let mut s; i = 0; s = 0; while i < a { s = s + (a + b) * (b + a) - i; i = i + 1; } return s + (a + b); } fn main(){ return f(4, 1) % 256; }" "99" "--inline-threshold=0"
+run_test "fn f(a, b, d, n){ let mut i; let mut s; i = 0; s = 0; while i < n { s = s + a * b + (a - 1); if d != 0 { s = s + 100 / d; } i = i + 1; } return s; } fn main(){ return f(3, 4, 0, 5) + f(3, 4, 50, 2); }" "102"
+run_test "fn f(a, b, n){ let mut i; let mut s; i = 0; s = 0; while i < n { let mut j; j = 0; if a < b { while j < n { s = s + (a * b) % 7 + i * a; j = j + 1; } } i = i + 1; } return s; } fn main(){ return f(3, 5, 4) + f(5, 3, 4); }" "88"
+run_test "fn f(x){ return (x / 10) * 1000 + (x % 10) * 100 + x / 8 + x % 2; } fn main(){ return (f(1234) - f(0 - 1234) - 246900) % 256; }" "208"
+run_test "fn f(x){ return x / (0 - 7) + x % (0 - 4) + x * 9 + x * 40 + x * 7; } fn main(){ return f(0 - 100) + 6000; }" "158" "--inline-threshold=0 --passes=mem2reg,sccp,strength,dce"
+run_test "fn f(n, k){ let mut i; let mut s; i = 0; s = 0; while i < n { s = s + i * 12 + i * k; i = i + 2; } return s; } fn main(){ return f(20, 3) % 256; }" "70"
+run_test "fn f(n, k){ let mut i; let mut s; i = 0; s = 0; while i < n { s = s + i * 12 + i * k; i = i + 2; } return s; } fn main(){ return f(20, 3) % 256; }" "70" "-O2"
+run_test "fn f(n, k){ let mut i; let mut s; i = 0; s = 0; while i < n { s = s + i * 12 + i * k; i = i + 2; } return s; } fn main(){ return f(20, 3) % 256; }" "70" "--passes=mem2reg,strength,licm,dce"
+run_test "fn f(n, k){ let mut i; let mut s; i = 0; s = 0; while i < n { s = s + i * 12 + i * k; i = i + 2; } return s; } fn main(){ return f(20, 3) % 256; }" "70" "--passes="
+run_obj_test "fn main(){return (2+3)*4 - 10 / 3 + 10 % 3;}" "18"
+run_obj_test "fn main(){let mut s; let mut i; s = 0; i = 0; while i < 8 { s = s + switch i { 1 => 10, 2 => 20, 3 => 30, 5 => 50, 6 => 60, }; i = i + 1; } return s;}" "170"
+run_obj_test "import io; fn main(){ print(\"obj\\n\"); return 3; }" "3"
+run_obj_test "fn g(x){ let v0; v0 = x + 0; let v1; v1 = x + 1; let v2; v2 = x + 2; let v3; v3 = x + 3; let v4; v4 = x + 4; let v5; v5 = x + 5; let v6; v6 = x + 6; let v7; v7 = x + 7; let v8; v8 = x + 8; let v9; v9 = x + 9; let v10; v10 = x + 10; let v11; v11 = x + 11; let v12; v12 = x + 12; let v13; v13 = x + 13; let v14; v14 = x + 14; let v15; v15 = x + 15; return v0 * v1 + v1 * v2 + v2 * v3 + v3 * v4 + v4 * v5 + v5 * v6 + v6 * v7 + v7 * v8 + v8 * v9 + v9 * v10 + v10 * v11 + v11 * v12 + v12 * v13 + v13 * v14 + v14 * v15 + v15 * v0; } fn main(){ return g(1) % 256; }" "96" "-O0"
+run_obj_test "fn sum(n, acc){ if n == 0 { return acc; } return sum(n - 1, acc + n); } fn main(){ return sum(10000000, 0) % 256; }" "64"
+run_link_test "fn main(){return (2+3)*4 - 10 / 3 + 10 % 3;}" "18"
+run_link_test "fn main(){let mut s; let mut i; s = 0; i = 0; while i < 8 { s = s + switch i { 1 => 10, 2 => 20, 3 => 30, 5 => 50, 6 => 60, }; i = i + 1; } return s;}" "170" "-O2"
+run_link_test "import io; fn main(){ print(\"linked\\n\"); return 4; }" "4"
+run_link_test "fn main(){ let z; z = 0; 5 / z; return 3; }" "136"
+run_jit_test "fn main(){return (2+3)*4 - 10 / 3 + 10 % 3;}" "18"
+run_jit_test "fn main(){let mut s; let mut i; s = 0; i = 0; while i < 8 { s = s + switch i { 1 => 10, 2 => 20, 3 => 30, 5 => 50, 6 => 60, }; i = i + 1; } return s;}" "170" "-O2"
+run_jit_test "import io; fn main(){ print(\"jit\\n\"); return 4; }" "4"
+run_jit_test "import io; fn main(){ exit(9); return 4; }" "9"
   
 #run_test "return 2+3*4;" "14"
 # More complex tests (commented out until parser supports them)
@@ -0,0 +1,423 @@
+.intel_syntax noprefix
+.section .rodata
+.LC0:
+  .string "FAILED: "
+.section .rodata
+.LC1:
+  .string "\n"
+.section .rodata
+.LC2:
+  .string "return 1"
+.section .rodata
+.LC3:
+  .string "compare_params(5,5)"
+.section .rodata
+.LC4:
+  .string "5+3"
+.section .rodata
+.LC5:
+  .string "10-4"
+.section .rodata
+.LC6:
+  .string "6*7"
+.section .rodata
+.LC7:
+  .string "20/4"
+.section .rodata
+.LC8:
+  .string "10%3"
+.section .rodata
+.LC9:
+  .string "2+3*4"
+.section .rodata
+.LC10:
+  .string "(2+3)*4"
+.section .rodata
+.LC11:
+  .string "10-2*3"
+.section .rodata
+.LC12:
+  .string "(10-2)*3"
+.section .rodata
+.LC13:
+  .string "2==2"
+.section .rodata
+.LC14:
+  .string "2!=3"
+.section .rodata
+.LC15:
+  .string "2==3"
+.section .rodata
+.LC16:
+  .string "2!=2"
+.section .rodata
+.LC17:
+  .string "2<3"
+.section .rodata
+.LC18:
+  .string "3<2"
+.section .rodata
+.LC19:
+  .string "2<=2"
+.section .rodata
+.LC20:
+  .string "2<=3"
+.section .rodata
+.LC21:
+  .string "3<=2"
+.section .rodata
+.LC22:
+  .string "3>>1"
+.section .rodata
+.LC23:
+  .string "4>>1"
+.section .rodata
+.LC24:
+  .string "4<<1"
+.section .rodata
+.LC25:
+  .string "1<<3"
+.section .rodata
+.LC26:
+  .string "1&3"
+.section .rodata
+.LC27:
+  .string "7&3"
+.section .rodata
+.LC28:
+  .string "5^3"
+.section .rodata
+.LC29:
+  .string "5|2"
+.section .rodata
+.LC30:
+  .string "1||0"
+.section .rodata
+.LC31:
+  .string "0||1"
+.section .rodata
+.LC32:
+  .string "0||0"
+.section .rodata
+.LC33:
+  .string "1&&1"
+.section .rodata
+.LC34:
+  .string "1&&0"
+.section .rodata
+.LC35:
+  .string "0&&1"
+.section .rodata
+.LC36:
+  .string "0&&0"
+.section .rodata
+.LC37:
+  .string "variable a = 0"
+.section .rodata
+.LC38:
+  .string "variable b = 1"
+.section .rodata
+.LC39:
+  .string "if-else test"
+.section .rodata
+.LC40:
+  .string "while loop"
+.section .rodata
+.LC41:
+  .string "while loop 2"
+.section .rodata
+.LC42:
+  .string "switch expression"
+.section .rodata
+.LC43:
+  .string "function call test_func()"
+.section .rodata
+.LC44:
+  .string "function call add(3, 4)"
+.section .rodata
+.LC45:
+  .string "deeply nested expression"
+.section .rodata
+.LC46:
+  .string "values live across calls"
+.section .rodata
+.LC47:
+  .string "loop-carried values"
+.section .rodata
+.LC48:
+  .string "constant condition"
+.section .rodata
+.LC49:
+  .string "switch jump table"
+.section .rodata
+.LC50:
+  .string "loop invariant code motion"
+.section .rodata
+.LC51:
+  .string "All tests passed!\n"
+.text
+.global test_func
+test_func:
+  mov rax, 7
+ret_test_func:
+  ret
+.global add
+add:
+  mov r10, rdi
+  mov r11, rsi
+  mov rsi, r10
+  add rsi, r11
+  mov rax, rsi
+ret_add:
+  ret
+.global assert
+assert:
+  push r12
+  mov r10, rdi
+  mov r11, rsi
+  mov r12, rdx
+  cmp r10, r11
+  je .Lassert1
+  lea r10, [rip + .LC0]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, r12
+  call print
+  lea r10, [rip + .LC1]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, 2
+  call exit
+  mov r10, rax
+.Lassert1:
+  xor eax, eax
+ret_assert:
+  pop r12
+  ret
+.global inc
+inc:
+  mov r10, rdi
+  mov r11, r10
+  add r11, 1
+  mov rax, r11
+ret_inc:
+  ret
+.global compare_params
+compare_params:
+  mov r10, rdi
+  mov r11, rsi
+  cmp r10, r11
+  jne .Lcompare_params1
+  mov rax, 1
+  jmp ret_compare_params
+.Lcompare_params1:
+  xor eax, eax
+ret_compare_params:
+  ret
+.global main
+main:
+  sub rsp, 8
+  push r12
+  push r13
+  xor r10d, r10d
+.Lmain20:
+  cmp r10, 5
+  jge .Lmain21
+  mov r11, r10
+  add r11, 1
+  mov r10, r11
+  jmp .Lmain20
+.Lmain21:
+  lea r12, [rip + .LC40]
+  cmp r10, 5
+  je .Lmain263
+  lea r10, [rip + .LC0]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, r12
+  call print
+  lea r10, [rip + .LC1]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, 2
+  call exit
+  mov r10, rax
+.Lmain263:
+  mov r10, 1
+.Lmain22:
+  cmp r10, 10
+  jge .Lmain23
+  mov r11, r10
+  shl r11, 1
+  mov r10, r11
+  jmp .Lmain22
+.Lmain23:
+  lea r12, [rip + .LC41]
+  cmp r10, 16
+  je .Lmain268
+  lea r10, [rip + .LC0]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, r12
+  call print
+  lea r10, [rip + .LC1]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, 2
+  call exit
+  mov r10, rax
+.Lmain268:
+  xor r12d, r12d
+  mov r10, 1
+  xor r11d, r11d
+.Lmain28:
+  cmp r11, 10
+  jge .Lmain29
+  mov rsi, r12
+  add rsi, r10
+  mov rdi, r11
+  add rdi, 1
+  mov r12, r10
+  mov r10, rsi
+  mov r11, rdi
+  jmp .Lmain28
+.Lmain29:
+  lea r13, [rip + .LC47]
+  cmp r12, 55
+  je .Lmain324
+  lea r10, [rip + .LC0]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, r13
+  call print
+  lea r10, [rip + .LC1]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, 2
+  call exit
+  mov r10, rax
+.Lmain324:
+  xor r10d, r10d
+  xor esi, esi
+.Lmain32:
+  cmp r10, 12
+  jge .Lmain33
+  mov rdi, r10
+  sub rdi, 2
+  cmp rdi, 8
+  jae .Lmain41
+  lea r11, [rip + .Ljt_main_0]
+  movsxd rax, dword ptr [r11 + rdi * 4]
+  add rax, r11
+  jmp rax
+.Lmain35:
+  mov r11, 1
+  jmp .Lmain34
+.Lmain36:
+  mov r11, 2
+  jmp .Lmain34
+.Lmain37:
+  mov r11, 3
+  jmp .Lmain34
+.Lmain38:
+  mov r11, 4
+  jmp .Lmain34
+.Lmain39:
+  mov r11, 5
+  jmp .Lmain34
+.Lmain40:
+  mov r11, 6
+  jmp .Lmain34
+.Lmain41:
+  xor r11d, r11d
+.Lmain34:
+  mov rdi, rsi
+  add rdi, r11
+  mov r11, r10
+  add r11, 1
+  mov r10, r11
+  mov rsi, rdi
+  jmp .Lmain32
+.Lmain33:
+  lea r13, [rip + .LC49]
+  cmp rsi, 21
+  je .Lmain334
+  lea r10, [rip + .LC0]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, r13
+  call print
+  lea r10, [rip + .LC1]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, 2
+  call exit
+  mov r10, rax
+.Lmain334:
+  mov r10, r12
+  shl r10, 1
+  xor r11d, r11d
+  xor esi, esi
+.Lmain42:
+  cmp r11, 5
+  jge .Lmain43
+  mov rdi, rsi
+  add rdi, r10
+  mov r8, r11
+  add r8, 1
+  mov r11, r8
+  mov rsi, rdi
+  jmp .Lmain42
+.Lmain43:
+  lea r12, [rip + .LC50]
+  cmp rsi, 550
+  je .Lmain339
+  lea r10, [rip + .LC0]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, r12
+  call print
+  lea r10, [rip + .LC1]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  mov rdi, 2
+  call exit
+  mov r10, rax
+.Lmain339:
+  lea r10, [rip + .LC51]
+  mov rdi, r10
+  call print
+  mov r11, rax
+  xor edi, edi
+  call exit
+  mov r10, rax
+  xor eax, eax
+ret_main:
+  pop r13
+  pop r12
+  add rsp, 8
+  ret
+.section .rodata
+  .align 4
+.Ljt_main_0:
+  .long .Lmain35 - .Ljt_main_0
+  .long .Lmain36 - .Ljt_main_0
+  .long .Lmain37 - .Ljt_main_0
+  .long .Lmain38 - .Ljt_main_0
+  .long .Lmain41 - .Ljt_main_0
+  .long .Lmain39 - .Ljt_main_0
+  .long .Lmain41 - .Ljt_main_0
+  .long .Lmain40 - .Ljt_main_0
+.text